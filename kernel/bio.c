@@ -7,11 +7,16 @@
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bwritev to write several at once.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To start reading a block that will be wanted soon, call
+//     bprefetch; it does not wait for the disk.
+// * To overwrite a whole block, call bfresh instead of bread;
+//     it skips reading the old contents from disk.
 
 
 #include "types.h"
@@ -96,12 +101,87 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
-    b->valid = 1;
+    // a prefetch may already be reading it.
+    virtio_disk_wait(b);
+    if(!b->valid) {
+      virtio_disk_rw(b, 0);
+      b->valid = 1;
+    }
+  }
+  return b;
+}
+
+// Return a locked buf for the indicated block without reading
+// it from disk, for a caller that will overwrite all of b->data.
+// If b->valid is 0 the contents are garbage; the caller sets
+// b->valid once it has filled the buffer, or leaves it 0 if it
+// gives up, so that the next bread goes to the disk.
+struct buf*
+bfresh(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(!b->valid) {
+    // let a prefetch finish rather than race with its DMA.
+    virtio_disk_wait(b);
   }
   return b;
 }
 
+// Start reading the indicated block into the cache, unless it
+// is already there, and return without waiting for the disk.
+// Best effort: does nothing if no buffer or disk slot is free.
+// The buffer is held (refcnt) but not locked while the read is
+// in flight; b->disk tells bread to wait for it.
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      release(&bcache.lock);
+      return;
+    }
+  }
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    if(b->refcnt == 0) {
+      b->dev = dev;
+      b->blockno = blockno;
+      b->valid = 0;
+      b->refcnt = 1;
+      b->disk = 1;
+      release(&bcache.lock);
+      if(virtio_disk_read_async(b) < 0)
+        bunpin(b);
+      return;
+    }
+  }
+  release(&bcache.lock);
+}
+
+// Called by the disk interrupt when a bprefetch read finishes.
+// Drop the prefetch's reference and make b most recently used,
+// so it survives until the reader gets to it.
+void
+bprefetched(struct buf *b)
+{
+  acquire(&bcache.lock);
+  b->valid = 1;
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    b->next = bcache.head.next;
+    b->prev = &bcache.head;
+    bcache.head.next->prev = b;
+    bcache.head.next = b;
+  }
+  release(&bcache.lock);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,6 +191,20 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write n locked buffers to disk together; return when all
+// of them are written.  Faster than n calls to bwrite, since
+// the disk works on several at once, but unordered.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+  virtio_disk_writev(bs, n);
+}
+
 // Release a locked buffer.
 // Move to the head of the most-recently-used list.
 void
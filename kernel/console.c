@@ -27,7 +27,7 @@
 
 //
 // send one character to the uart.
-// called by printf, and to echo input characters,
+// called to echo input characters,
 // but not from write().
 //
 void
@@ -35,9 +35,10 @@ consputc(int c)
 {
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    uartwrite("\b \b", 3, 0);
   } else {
-    uartputc_sync(c);
+    char ch = c;
+    uartwrite(&ch, 1, 0);
   }
 }
 
@@ -58,13 +59,14 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
+  char buf[128];
+  int i, m;
 
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  for(i = 0; i < n; i += m){
+    m = n - i < sizeof(buf) ? n - i : sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartwrite(buf, m, 1);
   }
 
   return i;
@@ -0,0 +1,186 @@
+//
+// Directory name cache.
+//
+// Remembers the results of directory lookups, keyed by
+// (device, directory inode number, name), so that path
+// resolution need not read through a directory for every
+// component.  A negative entry (inum 0) records that a name
+// is absent.
+//
+// Entries for a directory change only while the directory's
+// inode is locked, by the same code that changes the directory
+// on disk: dirlink() enters the new name, unlink replaces the
+// name with a negative entry, and freeing a directory inode
+// purges all of its entries.  Lookups may run without the
+// directory locked and then see either the old or the new state
+// of a concurrent change, as an unlocked reader of the
+// directory would.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint dir;             // inode number of the directory
+  char name[DIRSIZ];
+  uint inum;            // inode number named, or 0 if absent
+  uint off;             // offset of the dirent in dir, if present
+  struct dentry *hnext; // hash chain
+  struct dentry *prev;  // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry ent[NDCACHE];
+  struct dentry *hash[NDHASH];
+
+  // all entries, in use or not, most recently used first.
+  struct dentry head;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.ent; d < dcache.ent+NDCACHE; d++){
+    d->dir = 0;  // unused
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static uint
+dhash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for (dev, dir, name).
+// Caller holds dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->hnext)
+    if(d->dev == dev && d->dir == dir && strncmp(d->name, name, DIRSIZ) == 0)
+      return d;
+  return 0;
+}
+
+// Take d off its hash chain and make it the least recently used.
+// Caller holds dcache.lock.
+static void
+dremove(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dhash(d->dev, d->dir, d->name)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == d){
+      *pp = d->hnext;
+      break;
+    }
+  }
+  d->dir = 0;
+  d->prev->next = d->next;
+  d->next->prev = d->prev;
+  d->next = &dcache.head;
+  d->prev = dcache.head.prev;
+  dcache.head.prev->next = d;
+  dcache.head.prev = d;
+}
+
+// Move d to the front of the LRU list.
+// Caller holds dcache.lock.
+static void
+dtouch(struct dentry *d)
+{
+  d->prev->next = d->next;
+  d->next->prev = d->prev;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Look up name in directory dir on dev.  If the cache knows
+// the answer, return 1 and set *inum (0 if the name is absent)
+// and, if poff is not 0, *poff.  Otherwise return 0.
+int
+dcache_lookup(uint dev, uint dir, char *name, uint *inum, uint *poff)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  dtouch(d);
+  *inum = d->inum;
+  if(poff)
+    *poff = d->off;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory dir is inode inum, whose
+// dirent is at off, or that name is absent if inum is 0.
+// Caller holds dir's inode lock.
+void
+dcache_enter(uint dev, uint dir, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    // recycle the least recently used entry.
+    d = dcache.head.prev;
+    if(d->dir != 0)
+      dremove(d);
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    h = dhash(dev, dir, name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  dtouch(d);
+  release(&dcache.lock);
+}
+
+// Forget every entry for directory dir, which is being freed.
+void
+dcache_purge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.ent; d < dcache.ent+NDCACHE; d++)
+    if(d->dir == dir && d->dev == dev)
+      dremove(d);
+  release(&dcache.lock);
+}
@@ -2,20 +2,34 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
 struct proc;
+struct ratelimit;
+struct schedstat;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct sysstat;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bfresh(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bprefetch(uint, uint);
+void            bprefetched(struct buf*);
+
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(uint, uint, char*, uint*, uint*);
+void            dcache_enter(uint, uint, char*, uint, uint);
+void            dcache_purge(uint, uint);
 
 // console.c
 void            consoleinit(void);
@@ -31,8 +45,12 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filepread(struct file*, uint64, int n, uint);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepwrite(struct file*, uint64, int n, uint);
 
 // fs.c
 void            fsinit(int);
@@ -50,6 +68,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+void            iprefetch(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -63,13 +82,16 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kdup(void *);
 uint64          kfreepages_count(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+int             begin_opn(int);
 void            end_op(void);
+void            end_opn(int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -80,7 +102,10 @@ int             pipewrite(struct pipe*, uint64, int);
 // printf.c
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
-void            printfinit(void);
+void            kloginit(void);
+void            klog(char*, ...);
+int             ratelimit(struct ratelimit*);
+int             klogread(uint, uint64, int);
 
 // proc.c
 int             cpuid(void);
@@ -90,6 +115,7 @@ int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
+void            mmrfree(struct proc*);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
@@ -101,7 +127,14 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeup_one(void*);
 void            yield(void);
+void            kick(struct proc*);
+int             setnice(int, int);
+int             setaffinity(int, uint);
+int             getaffinity(int);
+int             getschedstat(int, struct schedstat*);
+void            vdsoupdate(struct proc*);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -145,6 +178,26 @@ int             argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+void            sysstat_merge(struct sysstat*, struct sysstat*);
+void            sysstat_all(struct sysstat*);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, uint64, uint64);
+
+// textcache.c
+void            textcacheinit(void);
+char*           textcache_lookup(uint, uint, uint64);
+void            textcache_enter(uint, uint, uint64, char*);
+void            textcache_purge(uint, uint);
+void            textcache_shrink(void);
+
+// timer.c
+void            wheelinit(void);
+void            timer_tick(void);
+uint            timer_next(void);
+int             ticksleep(int);
+int             nanosleep(uint64);
 
 // trap.c
 extern uint     ticks;
@@ -152,12 +205,18 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+int             vmfault(pagetable_t, uint64, int);
+int             vmprefault(uint64, uint64);
+void            cpuidle(void);
+void            ipi(int);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+void            uartwrite(char*, int, int);
+int             uarttrywrite(char*, int);
 void            uartputc_sync(int);
+void            uartflush_sync(void);
 int             uartgetc(void);
 
 // vm.c
@@ -172,6 +231,7 @@ uint64          uvmdealloc(pagetable_t, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -189,12 +249,17 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_writev(struct buf **, int);
+int             virtio_disk_read_async(struct buf *);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
 
 // semaphore.c
 void            seminit(void);
 int             semalloc(void);
 void            semdealloc(int id);
+int             semwait(int);
+int             sempost(int);
 extern struct semtab semtable;
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -3,3 +3,9 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// one buffer for readv() and writev().
+struct iovec {
+  void *iov_base;
+  int iov_len;
+};
@@ -12,17 +12,50 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "fcntl.h"
+
+// log blocks a file write may modify besides its data; see inodewrite().
+#define WRITEMETA 8
 
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
   struct file file[NFILE];
+  struct file *free;   // entries with ref 0
 } ftable;
 
+// Put f on the free list.
+// Caller holds ftable.lock.
+static void
+ffreelist_push(struct file *f)
+{
+  f->next = ftable.free;
+  ftable.free = f;
+}
+
+// Add a page of entries to the table.
+// Caller holds ftable.lock.
+static int
+fgrow(void)
+{
+  struct file *f, *page;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  memset(page, 0, PGSIZE);
+  for(f = page; f < page + PGSIZE / sizeof(*f); f++)
+    ffreelist_push(f);
+  return 0;
+}
+
 void
 fileinit(void)
 {
+  struct file *f;
+
   initlock(&ftable.lock, "ftable");
+  for(f = ftable.file + NFILE - 1; f >= ftable.file; f--)
+    ffreelist_push(f);
 }
 
 // Allocate a file structure.
@@ -32,15 +65,15 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.free == 0 && fgrow() < 0){
+    release(&ftable.lock);
+    return 0;
   }
+  f = ftable.free;
+  ftable.free = f->next;
+  f->ref = 1;
   release(&ftable.lock);
-  return 0;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -71,6 +104,7 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  ffreelist_push(f);
   release(&ftable.lock);
 
   if(ff.type == FD_PIPE){
@@ -101,78 +135,223 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Called with f->ip locked after reading n bytes at off.
+// While f is read sequentially, keep the next f->rawin blocks
+// in flight to the buffer cache, doubling the window on each
+// sequential read up to MAXREADAHEAD.  Any seek resets it.
+static void
+readahead(struct file *f, uint off, int n)
+{
+  uint next, start;
+
+  if(off != f->ranext){
+    f->rawin = 0;
+    f->raend = 0;
+    f->ranext = off + n;
+    return;
+  }
+  f->ranext = off + n;
+  if(f->rawin == 0)
+    f->rawin = 2;
+  else if(f->rawin < MAXREADAHEAD)
+    f->rawin *= 2;
+  if(f->rawin > MAXREADAHEAD)
+    f->rawin = MAXREADAHEAD;
+
+  // don't re-issue blocks already read ahead.
+  next = f->ranext / BSIZE;
+  start = f->raend > next ? f->raend : next;
+  if(start < next + f->rawin){
+    iprefetch(f->ip, start, next + f->rawin - start);
+    f->raend = next + f->rawin;
+  }
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
 fileread(struct file *f, uint64 addr, int n)
 {
-  int r = 0;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1);
+}
+
+// Read from file f into the user buffers iov[0..cnt), in
+// order, stopping early at end of file.  A file's i-node is
+// locked once for all of them.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r = 0, ret = 0;
 
   if(f->readable == 0)
     return -1;
 
-  if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+  // see vmprefault().
+  for(i = 0; i < cnt; i++)
+    if(vmprefault((uint64)iov[i].iov_base, iov[i].iov_len) < 0)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+
+  if(f->type == FD_PIPE || f->type == FD_DEVICE){
+    if(f->type == FD_DEVICE &&
+       (f->major < 0 || f->major >= NDEV || !devsw[f->major].read))
+      return -1;
+    for(i = 0; i < cnt; i++){
+      if(f->type == FD_PIPE)
+        r = piperead(f->pipe, (uint64)iov[i].iov_base, iov[i].iov_len);
+      else
+        r = devsw[f->major].read(1, (uint64)iov[i].iov_base, iov[i].iov_len);
+      if(r < 0)
+        return ret ? ret : -1;
+      ret += r;
+      if(r != iov[i].iov_len)
+        break;
+    }
   } else if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
+    for(i = 0; i < cnt; i++){
+      if((r = readi(f->ip, 1, (uint64)iov[i].iov_base, f->off, iov[i].iov_len)) > 0){
+        readahead(f, f->off, r);
+        f->off += r;
+      }
+      if(r < 0){
+        if(ret == 0)
+          ret = -1;
+        break;
+      }
+      ret += r;
+      if(r != iov[i].iov_len)
+        break;
+    }
     iunlock(f->ip);
   } else {
     panic("fileread");
   }
 
+  return ret;
+}
+
+// Read from file f at offset off, leaving f's offset alone,
+// so that several processes sharing f can read it at once.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  if(vmprefault(addr, n) < 0)
+    return -1;
+  ilock(f->ip);
+  r = readi(f->ip, 1, addr, off, n);
+  iunlock(f->ip);
   return r;
 }
 
+// Write the user buffers iov[0..cnt) to ip at *off, advancing
+// *off.  Puts as many blocks in each log transaction as the log
+// has room for, leaving WRITEMETA blocks for the i-node, an
+// indirect, a doubly-indirect and two of its indirect blocks,
+// two allocation blocks, and a block of slop for non-aligned
+// writes.  Returns the number of bytes written, or -1 if
+// writei() failed part way.
+static int
+inodewrite(struct inode *ip, struct iovec *iov, int cnt, uint *off)
+{
+  int i, tot, left, done, n1, max, want, got, r;
+
+  left = 0;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len < 0)
+      return -1;
+    left += iov[i].iov_len;
+  }
+  tot = left;
+
+  i = 0;
+  done = 0;  // bytes of iov[i] written
+  while(left > 0){
+    want = (left + BSIZE - 1) / BSIZE + WRITEMETA;
+    got = begin_opn(want);
+    max = (got - WRITEMETA) * BSIZE;
+
+    ilock(ip);
+    r = 0;
+    while(max > 0 && i < cnt){
+      n1 = iov[i].iov_len - done;
+      if(n1 > max)
+        n1 = max;
+      if((r = writei(ip, 1, (uint64)iov[i].iov_base + done, *off, n1)) > 0)
+        *off += r;
+      if(r != n1)
+        break;
+      max -= n1;
+      left -= n1;
+      done += n1;
+      if(done == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+    }
+    iunlock(ip);
+    end_opn(got);
+
+    if(max > 0 && i < cnt){
+      // error from writei
+      return -1;
+    }
+  }
+  return tot;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1);
+}
+
+// Write the user buffers iov[0..cnt) to file f, in order.
+// A file's buffers all go to the disk in the same log
+// transaction if the log has room for them.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, ret = 0;
 
   if(f->writable == 0)
     return -1;
 
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+  // see vmprefault().
+  for(i = 0; i < cnt; i++)
+    if(vmprefault((uint64)iov[i].iov_base, iov[i].iov_len) < 0)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
 
-      if(r != n1){
-        // error from writei
+  if(f->type == FD_PIPE || f->type == FD_DEVICE){
+    if(f->type == FD_DEVICE &&
+       (f->major < 0 || f->major >= NDEV || !devsw[f->major].write))
+      return -1;
+    for(i = 0; i < cnt; i++){
+      if(f->type == FD_PIPE)
+        r = pipewrite(f->pipe, (uint64)iov[i].iov_base, iov[i].iov_len);
+      else
+        r = devsw[f->major].write(1, (uint64)iov[i].iov_base, iov[i].iov_len);
+      if(r < 0)
+        return ret ? ret : -1;
+      ret += r;
+      if(r != iov[i].iov_len)
         break;
-      }
-      i += r;
     }
-    ret = (i == n ? n : -1);
+  } else if(f->type == FD_INODE){
+    ret = inodewrite(f->ip, iov, cnt, &f->off);
   } else {
     panic("filewrite");
   }
@@ -180,3 +359,18 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Write to file f at offset off, leaving f's offset alone.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  if(vmprefault(addr, n) < 0)
+    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return inodewrite(f->ip, &iov, 1, &off);
+}
+
@@ -6,13 +6,19 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  uint ranext;       // FD_INODE: where the next sequential read starts
+  uint rawin;        // FD_INODE: readahead window in blocks, 0 if random
+  uint raend;        // FD_INODE: first block not yet read ahead
   short major;       // FD_DEVICE
+  struct file *next; // ftable's free list, if ref is 0
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
+#define NMAPCACHE 32  // indirect entries cached per inode; divides NINDIRECT
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
@@ -26,7 +32,20 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+
+  // copy of NMAPCACHE consecutive entries of an indirect block,
+  // mapping file blocks NDIRECT+mapbase .. NDIRECT+mapbase+mapn-1.
+  uint mapbase;
+  uint mapn;
+  uint map[NMAPCACHE];
+
+  uint lastblock;     // last block allocated to this inode, or 0
+  int text;           // pages of this file may be in the text cache
+
+  struct inode *hnext;  // itable hash chain
+  struct inode *prev;   // itable free list, if ref is 0
+  struct inode *next;
 };
 
 // map major device number to device functions.
@@ -38,3 +57,4 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define TRACE   2
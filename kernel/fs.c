@@ -37,6 +37,8 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+static void bsuminit(int);
+
 // Init fs
 void
 fsinit(int dev) {
@@ -44,6 +46,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
 }
 
 // Zero a block.
@@ -52,39 +55,123 @@ bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bfresh(dev, bno);
   memset(bp->data, 0, BSIZE);
+  bp->valid = 1;
   log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
+//
+// bfree[i] counts the free blocks that bitmap block i describes,
+// so balloc can skip full bitmap blocks without reading them.
+// Each count is changed only while holding the lock of its
+// bitmap block's buffer; unlocked reads are just hints.
+
+static uint bfreecnt[MAXBMAP];
+static uint nbmap;     // bitmap blocks in use
+
+// Index of the lowest set bit in x, which must not be 0.
+// Written out, since the kernel doesn't link libgcc.
+static int
+ctz64(uint64 x)
+{
+  int n = 0;
+
+  if((x & 0xffffffff) == 0){ n += 32; x >>= 32; }
+  if((x & 0xffff) == 0){ n += 16; x >>= 16; }
+  if((x & 0xff) == 0){ n += 8; x >>= 8; }
+  if((x & 0xf) == 0){ n += 4; x >>= 4; }
+  if((x & 0x3) == 0){ n += 2; x >>= 2; }
+  if((x & 0x1) == 0)
+    n += 1;
+  return n;
+}
+
+// Return the first clear bit at or after bit start of the
+// bitmap in bp, or -1.  Scans a 64-bit word at a time.
+static int
+bitscan(struct buf *bp, int start)
+{
+  uint64 *w = (uint64*)bp->data;
+  uint64 x;
+  int i;
+
+  i = start / 64;
+  x = ~w[i] & (~0UL << (start % 64));
+  while(x == 0){
+    if(++i >= BPB / 64)
+      return -1;
+    x = ~w[i];
+  }
+  return i * 64 + ctz64(x);
+}
+
+// Count the free blocks in each bitmap block.
+static void
+bsuminit(int dev)
+{
+  struct buf *bp;
+  int i, bi, b;
+
+  nbmap = (sb.size + BPB - 1) / BPB;
+  if(nbmap > MAXBMAP)
+    panic("bsuminit: disk too big");
+  for(i = 0; i < nbmap; i++){
+    bp = bread(dev, sb.bmapstart + i);
+    bfreecnt[i] = 0;
+    for(bi = 0; bi < BPB && (bi = bitscan(bp, bi)) >= 0; bi++){
+      b = i * BPB + bi;
+      if(b >= sb.size)
+        break;
+      bfreecnt[i]++;
+    }
+    brelse(bp);
+  }
+}
 
-// Allocate a zeroed disk block.
+// Allocate a zeroed disk block, preferring the first free
+// block at or after goal.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-  int b, bi, m;
+  int i, bm, bi, b;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  if(goal >= sb.size)
+    goal = 0;
+  // visit the goal's bitmap block twice: once from the goal
+  // on, and once more at the end for the blocks before it.
+  for(i = 0; i <= nbmap; i++){
+    bm = (goal / BPB + i) % nbmap;
+    if(bfreecnt[bm] == 0)
+      continue;
+    bp = bread(dev, sb.bmapstart + bm);
+    bi = bitscan(bp, i == 0 ? goal % BPB : 0);
+    b = bm * BPB + bi;
+    if(bi >= 0 && b < sb.size){
+      bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
+      bfreecnt[bm]--;
+      log_write(bp);
+      brelse(bp);
+      bzero(dev, b);
+      return b;
     }
     brelse(bp);
   }
   panic("balloc: out of blocks");
 }
 
+// Allocate a block for ip, just after the last one it got,
+// so that a file written sequentially is laid out sequentially.
+static uint
+iballoc(struct inode *ip)
+{
+  ip->lastblock = balloc(ip->dev, ip->lastblock + 1);
+  return ip->lastblock;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -98,6 +185,7 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  bfreecnt[b / BPB]++;
   log_write(bp);
   brelse(bp);
 }
@@ -132,13 +220,15 @@ bfree(int dev, uint b)
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref.  A free entry keeps its contents and
+//   stays findable by iget() until it is recycled for a
+//   different inode, least recently used first.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode on disk.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -162,52 +252,117 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
+// Entries are found through a hash table on (dev, inum).  The
+// table starts with NINODE entries and grows a page of entries
+// at a time whenever every entry is referenced.
+//
 // The itable.lock spin-lock protects the allocation of itable
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// holds, one must hold itable.lock while using any of those
+// fields, or the hash and free-list links.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 67
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+
+  // entries with ref 0, most recently used first.
+  struct inode free;
 } itable;
 
+// Put ip at the front of the free list.
+// Caller holds itable.lock.
+static void
+ifreelist_push(struct inode *ip)
+{
+  ip->next = itable.free.next;
+  ip->prev = &itable.free;
+  itable.free.next->prev = ip;
+  itable.free.next = ip;
+}
+
+// Take ip off the free list.
+// Caller holds itable.lock.
+static void
+ifreelist_remove(struct inode *ip)
+{
+  ip->prev->next = ip->next;
+  ip->next->prev = ip->prev;
+}
+
+// Add a page of entries to the table.
+// Caller holds itable.lock.
+static int
+igrow(void)
+{
+  struct inode *ip, *page;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  memset(page, 0, PGSIZE);
+  for(ip = page; ip < page + PGSIZE / sizeof(*ip); ip++){
+    initsleeplock(&ip->lock, "inode");
+    ifreelist_push(ip);
+  }
+  return 0;
+}
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&itable.lock, "itable");
+  itable.free.next = &itable.free;
+  itable.free.prev = &itable.free;
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
+    ifreelist_push(&itable.inode[i]);
   }
 }
 
 static struct inode* iget(uint dev, uint inum);
 
+// ialloc's scans are next-fit: each starts in the inode block
+// where the previous allocation succeeded.
+static uint inextblock;
+
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
+
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int inum, i, n, blk, nblk;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
+  nblk = (sb.ninodes + IPB - 1) / IPB;
+  for(n = 0; n < nblk; n++){
+    blk = (inextblock + n) % nblk;
+    bp = bread(dev, sb.inodestart + blk);
+    for(i = 0; i < IPB; i++){
+      inum = blk * IPB + i;
+      if(inum == 0 || inum >= sb.ninodes)
+        continue;
+      dip = (struct dinode*)bp->data + i;
+      if(dip->type == 0){  // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        inextblock = blk;
+        return iget(dev, inum);
+      }
     }
     brelse(bp);
   }
@@ -242,31 +397,42 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = itable.hash[IHASH(dev, inum)]; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref == 0)
+        ifreelist_remove(ip);
       ip->ref++;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Recycle the least recently used free entry.
+  if(itable.free.prev == &itable.free && igrow() < 0)
     panic("iget: no inodes");
+  ip = itable.free.prev;
+  ifreelist_remove(ip);
+  if(ip->text){
+    textcache_purge(ip->dev, ip->inum);
+    ip->text = 0;
+  }
+  if(ip->inum){
+    for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = itable.hash[IHASH(dev, inum)];
+  itable.hash[IHASH(dev, inum)] = ip;
   release(&itable.lock);
 
   return ip;
@@ -305,6 +471,8 @@ ilock(struct inode *ip)
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->mapn = 0;
+    ip->lastblock = 0;
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -343,6 +511,8 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
+    if(ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -354,6 +524,8 @@ iput(struct inode *ip)
   }
 
   ip->ref--;
+  if(ip->ref == 0)
+    ifreelist_push(ip);
   release(&itable.lock);
 }
 
@@ -370,7 +542,36 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The NDINDIRECT blocks
+// after that are listed in the blocks listed in the doubly
+// indirect block ip->addrs[NDIRECT+1].
+//
+// To spare sequential readers a bread of an indirect block per
+// data block, ip->map[] caches the run of entries around the
+// last one looked up.
+
+// Return entry i of indirect block addr, allocating a block for
+// it if it is empty, and load the entries around it into ip's
+// map cache.  lbn is the file block entry i maps, less NDIRECT.
+static uint
+bmapind(struct inode *ip, uint addr, uint i, uint lbn)
+{
+  uint *a, first;
+  struct buf *bp;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = iballoc(ip);
+    log_write(bp);
+  }
+  first = i - i % NMAPCACHE;
+  memmove(ip->map, a + first, sizeof(ip->map));
+  ip->mapbase = lbn - (i - first);
+  ip->mapn = NMAPCACHE;
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -382,37 +583,73 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = iballoc(ip);
     return addr;
   }
   bn -= NDIRECT;
 
+  if(bn - ip->mapbase < ip->mapn && (addr = ip->map[bn - ip->mapbase]) != 0)
+    return addr;
+
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = iballoc(ip);
+    return bmapind(ip, addr, bn, bn);
+  }
+
+  if(bn - NINDIRECT < NDINDIRECT){
+    // Load the doubly-indirect block, then the indirect
+    // block it lists, allocating each if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = iballoc(ip);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if((addr = a[(bn - NINDIRECT) / NINDIRECT]) == 0){
+      a[(bn - NINDIRECT) / NINDIRECT] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
-    return addr;
+    return bmapind(ip, addr, (bn - NINDIRECT) % NINDIRECT, bn);
   }
 
   panic("bmap: out of range");
 }
 
+// Free indirect block addr and the blocks it lists.
+// If depth > 1, those are themselves indirect blocks.
+static void
+itruncind(uint dev, uint addr, int depth)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j]){
+      if(depth > 1)
+        itruncind(dev, a[j], depth - 1);
+      else
+        bfree(dev, a[j]);
+    }
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
+  if(ip->text){
+    textcache_purge(ip->dev, ip->inum);
+    ip->text = 0;
+  }
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -421,17 +658,17 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    itruncind(ip->dev, ip->addrs[NDIRECT], 1);
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    itruncind(ip->dev, ip->addrs[NDIRECT+1], 2);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
+  ip->mapn = 0;
+  ip->lastblock = 0;
   ip->size = 0;
   iupdate(ip);
 }
@@ -476,6 +713,19 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Start reading up to n blocks of ip's data, from block bn on,
+// into the buffer cache without waiting for them.
+// Caller must hold ip->lock.
+void
+iprefetch(struct inode *ip, uint bn, uint n)
+{
+  uint nblocks = (ip->size + BSIZE - 1) / BSIZE;
+
+  // every block below size exists, so bmap won't allocate.
+  for(; n > 0 && bn < nblocks; bn++, n--)
+    bprefetch(ip->dev, bmap(ip, bn));
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -493,14 +743,24 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->text){
+    // running programs keep their copies of pages they have.
+    textcache_purge(ip->dev, ip->inum);
+    ip->text = 0;
+  }
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    // a write that covers the whole block needn't read it first.
+    if(m == BSIZE)
+      bp = bfresh(ip->dev, bmap(ip, off/BSIZE));
+    else
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       break;
     }
+    bp->valid = 1;
     log_write(bp);
     brelse(bp);
   }
@@ -535,6 +795,9 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcache_lookup(dp->dev, dp->inum, name, &inum, poff))
+    return inum ? iget(dp->dev, inum) : 0;
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -545,10 +808,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp->dev, dp->inum, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  dcache_enter(dp->dev, dp->inum, name, 0, 0);
   return 0;
 }
 
@@ -578,6 +843,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcache_enter(dp->dev, dp->inum, name, inum, off);
 
   return 0;
 }
@@ -629,6 +895,7 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  uint inum;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
@@ -636,6 +903,26 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    // only directories have cached entries, so on a hit
+    // there's no need to lock ip to check its type.
+    if(!(nameiparent && *path == '\0') &&
+       dcache_lookup(ip->dev, ip->inum, name, &inum, 0)){
+      if(inum == 0){
+        iput(ip);
+        return 0;
+      }
+      // without ip locked, inum may be unlinked, freed and
+      // reused before iget().  Once held it cannot be freed,
+      // so it is the right inode if name still names it.
+      next = iget(ip->dev, inum);
+      if(dcache_lookup(ip->dev, ip->inum, name, &inum, 0) &&
+         inum == next->inum){
+        iput(ip);
+        ip = next;
+        continue;
+      }
+      iput(next);  // it changed; ask the directory.
+    }
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -24,9 +24,31 @@ struct superblock {
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+// The log's first block is a logsuper; the rest is a circular
+// buffer of committed transactions not yet written to their home
+// locations.  Each transaction is a logcommit block listing the
+// blocks it changed, followed by their new contents.
+struct logsuper {
+  uint magic;        // Must be LOGMAGIC
+  uint seq;          // Sequence number of the transaction at tail
+  uint tail;         // Position of the oldest transaction
+};
+
+struct logcommit {
+  uint magic;        // Must be COMMITMAGIC
+  uint seq;          // One more than the previous transaction's
+  uint n;            // Number of blocks that follow
+  uint sum;          // Checksum of this block, with sum 0, and the n blocks
+  uint block[];      // Home block numbers
+};
+
+#define LOGMAGIC    0x4c4f4721
+#define COMMITMAGIC 0x434d4954
+
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -35,7 +57,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
 };
 
 // Inodes per block.
@@ -47,6 +69,10 @@ struct dinode {
 // Bitmap bits per block
 #define BPB           (BSIZE*8)
 
+// Most bitmap blocks a file system may have, enough for a 2 GiB
+// disk; the kernel keeps a free count for each.
+#define MAXBMAP 256
+
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
 
@@ -1,6 +1,11 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each page has a reference count, so that a page can be mapped
+// by several processes and held by the text page cache at once:
+// kalloc() returns a page with one reference, kdup() adds one,
+// and kfree() drops one and frees the page when none are left.
 
 #include "types.h"
 #include "param.h"
@@ -22,8 +27,11 @@ struct {
   struct spinlock lock;
   struct run *freelist;
   uint64 nfree;            // number of free physical pages
+  ushort ref[(PHYSTOP - KERNBASE) / PGSIZE];
 } kmem;
 
+#define PGREF(pa) kmem.ref[((uint64)(pa) - KERNBASE) / PGSIZE]
+
 void
 kinit()
 {
@@ -37,14 +45,17 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    PGREF(p) = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by pa, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last.
+// (The exception is when initializing the allocator; see
+// kinit above.)
 void
 kfree(void *pa)
 {
@@ -53,6 +64,15 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(PGREF(pa) < 1)
+    panic("kfree: ref");
+  if(--PGREF(pa) > 0){
+    release(&kmem.lock);
+    return;
+  }
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -75,10 +95,18 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
+  if(r == 0){
+    // out of memory: give back the text page cache and retry.
+    release(&kmem.lock);
+    textcache_shrink();
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+  }
   if(r)
   {
     kmem.freelist = r->next;
     kmem.nfree--;
+    PGREF(r) = 1;
   }
   
   release(&kmem.lock);
@@ -88,13 +116,27 @@ kalloc(void)
   return (void*)r;
 }
 
+// Add a reference to the allocated page pa.
+void
+kdup(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kdup");
+
+  acquire(&kmem.lock);
+  if(PGREF(pa) < 1)
+    panic("kdup: ref");
+  PGREF(pa)++;
+  release(&kmem.lock);
+}
+
 // Return how many free physical pages are currently available.
+// Reads kmem.nfree without kmem.lock, since the clock interrupt
+// calls this on every CPU at every tick (see vdsoupdate()); an
+// aligned 64-bit load is atomic, and the count may change as
+// soon as it is returned either way.
 uint64
 kfreepages_count(void)
 {
-  uint64 n;
-  acquire(&kmem.lock);
-  n = kmem.nfree;
-  release(&kmem.lock);
-  return n;
+  return *(volatile uint64*)&kmem.nfree;
 }
@@ -0,0 +1,26 @@
+// Kernel log records, as klogread() returns them.
+// Both the kernel and user programs use this header file.
+
+#define NKLOG     128   // messages the kernel keeps
+#define KLOGTEXT  116   // longest message, in bytes
+
+struct klogrec {
+  uint seq;             // 1 for the first message since boot
+  uint ticks;           // when it was logged
+  ushort cpu;           // CPU that logged it
+  ushort len;           // bytes of text; no newline, not terminated
+  char text[KLOGTEXT];
+};
+
+// A limit on how often one kind of message is logged, for the
+// kernel's ratelimit(): at most RATEBURST of them in any
+// RATEINTERVAL ticks.
+#define RATEBURST    10
+#define RATEINTERVAL 50
+
+struct ratelimit {
+  char *name;           // says which messages were suppressed
+  uint begin;           // tick the current interval began
+  int n;                // messages logged in it
+  int missed;           // and suppressed
+};
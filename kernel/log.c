@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -17,21 +18,35 @@
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
+// the count of in-progress FS system calls, reserves
+// MAXOPBLOCKS of log space and returns.
+// But if the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// A caller that can split its work to fit, like a large
+// file write, uses begin_opn()/end_opn() to reserve as much
+// of the remaining log as is free.
 //
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
-
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+// The on-disk log format (see struct logsuper and struct
+// logcommit in fs.h):
+//   log super block: sequence number and position of the
+//     oldest transaction not yet installed
+//   a circular buffer of transactions, each:
+//     commit block, listing block #s A, B, C, ... and a checksum
+//     block A
+//     block B
+//     block C
+//     ...
+// A transaction's blocks are written all at once; the checksum,
+// not the order of writes, tells recovery whether it finished.
+// A commit therefore waits for the disk once.
+//
+// Committed blocks stay pinned in the buffer cache and are
+// installed at their home locations later, by checkpoint(),
+// when the log or the cache runs short of room.  Until then
+// the log is the only on-disk copy of their new contents.
+
+// The current transaction's block numbers.
 struct logheader {
   int n;
   int block[LOGSIZE];
@@ -41,102 +56,184 @@ struct log {
   struct spinlock lock;
   int start;
   int size;
+  int max;         // most blocks one transaction may log.
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks promised to outstanding calls.
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
+
+  // committed transactions, not yet installed.
+  uint seq;        // sequence number of the next transaction
+  int tail;        // position of the oldest
+  int used;        // log blocks they occupy
+  int nck;         // their distinct blocks, each pinned once:
+  int ckblock[2*LOGSIZE];
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void checkpoint(void);
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
+  if (sizeof(struct logcommit) + LOGSIZE*sizeof(uint) > BSIZE)
+    panic("initlog: too big logcommit");
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  // a transaction and its commit block must fit in the
+  // circular buffer, which follows the log super block.
+  log.max = LOGSIZE < log.size - 2 ? LOGSIZE : log.size - 2;
+  if(log.max < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(int recovering)
+// Block number of position pos in the circular buffer.
+static int
+logblock(int pos)
 {
-  int tail;
+  return log.start + 1 + pos % (log.size - 1);
+}
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+// Fold the words of a block into a running checksum.
+static uint
+cksum(uint sum, void *data)
+{
+  uint *w;
+
+  for(w = data; w < (uint*)data + BSIZE/sizeof(uint); w++)
+    sum = (sum ^ *w) * 16777619;
+  return sum;
 }
 
-// Read the log header from disk into the in-memory log header
+// Record on disk that the log is empty up to position tail,
+// where a transaction numbered seq will go next.
 static void
-read_head(void)
+write_super(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
-  }
+  struct buf *buf = bfresh(log.dev, log.start);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+
+  memset(buf->data, 0, BSIZE);
+  buf->valid = 1;
+  ls->magic = LOGMAGIC;
+  ls->seq = log.seq;
+  ls->tail = log.tail;
+  bwrite(buf);
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
-static void
-write_head(void)
+// If the transaction at pos is the complete transaction
+// numbered seq, return its commit block; otherwise return 0.
+// The caller must brelse the commit block.
+static struct buf*
+read_commit(int pos, uint seq)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
+  struct buf *cb, *bp;
+  struct logcommit *lc;
+  uint sum, want;
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+
+  cb = bread(log.dev, logblock(pos));
+  lc = (struct logcommit *) (cb->data);
+  if(lc->magic != COMMITMAGIC || lc->seq != seq || lc->n > log.max){
+    brelse(cb);
+    return 0;
   }
-  bwrite(buf);
-  brelse(buf);
+  want = lc->sum;
+  lc->sum = 0;
+  sum = cksum(2166136261, lc);
+  lc->sum = want;
+  for(i = 0; i < lc->n; i++){
+    bp = bread(log.dev, logblock(pos + 1 + i));
+    sum = cksum(sum, bp->data);
+    brelse(bp);
+  }
+  if(sum != want){
+    brelse(cb);
+    return 0;
+  }
+  return cb;
 }
 
+// Replay every complete transaction in the log, in order,
+// then mark the log empty.
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct buf *buf, *cb, *lbuf, *dbuf;
+  struct logsuper *ls;
+  struct logcommit *lc;
+  int i, n, scanned;
+
+  buf = bread(log.dev, log.start);
+  ls = (struct logsuper *) (buf->data);
+  if(ls->magic != LOGMAGIC)
+    panic("recover_from_log: bad log");
+  log.seq = ls->seq;
+  log.tail = ls->tail % (log.size - 1);
+  brelse(buf);
+
+  for(scanned = 0; scanned < log.size - 1; scanned += n + 1){
+    if((cb = read_commit(log.tail, log.seq)) == 0)
+      break;
+    lc = (struct logcommit *) (cb->data);
+    n = lc->n;
+    for(i = 0; i < n; i++){
+      lbuf = bread(log.dev, logblock(log.tail + 1 + i));
+      dbuf = bfresh(log.dev, lc->block[i]);
+      memmove(dbuf->data, lbuf->data, BSIZE);
+      dbuf->valid = 1;
+      bwrite(dbuf);
+      brelse(lbuf);
+      brelse(dbuf);
+    }
+    log.tail = (log.tail + n + 1) % (log.size - 1);
+    log.seq++;
+    brelse(cb);
+  }
+  log.used = 0;
+  write_super();
 }
 
 // called at the start of each FS system call.
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the start of an FS operation that may log up to
+// want blocks but can make do with fewer.  Waits until at least
+// min(want, MAXOPBLOCKS) blocks of log space are free, reserves
+// as many as are free up to want, and returns the number
+// reserved.  The caller must pass that number to end_opn().
+int
+begin_opn(int want)
+{
+  int n;
+
   acquire(&log.lock);
   while(1){
+    n = log.max - log.lh.n - log.reserved;
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(n < want && n < MAXOPBLOCKS){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
+      if(n > want)
+        n = want;
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
-      break;
+      return n;
     }
   }
 }
@@ -145,11 +242,20 @@ begin_op(void)
 // commits if this was the last outstanding operation.
 void
 end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// called at the end of an operation started by begin_opn(),
+// with the number of blocks it reserved.
+void
+end_opn(int reserved)
 {
   int do_commit = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= reserved;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -157,8 +263,8 @@ end_op(void)
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
+    // and releasing this op's reservation has
+    // freed some.
     wakeup(&log);
   }
   release(&log.lock);
@@ -174,31 +280,104 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write the current transaction, commit block first, to the
+// log in one batch.  The transaction has committed when this
+// returns.
 static void
 write_log(void)
 {
+  static struct buf *bufs[LOGSIZE+1];  // only one commit at a time
+  struct logcommit *lc;
+  struct buf *from;
+  uint sum;
   int tail;
 
+  bufs[0] = bfresh(log.dev, logblock(log.tail + log.used));
+  lc = (struct logcommit *) (bufs[0]->data);
+  memset(bufs[0]->data, 0, BSIZE);
+  bufs[0]->valid = 1;
+  lc->magic = COMMITMAGIC;
+  lc->seq = log.seq;
+  lc->n = log.lh.n;
+  for (tail = 0; tail < log.lh.n; tail++)
+    lc->block[tail] = log.lh.block[tail];
+  sum = cksum(2166136261, lc);
+
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    bufs[tail+1] = bfresh(log.dev, logblock(log.tail + log.used + 1 + tail));
+    from = bread(log.dev, log.lh.block[tail]); // cache block
+    memmove(bufs[tail+1]->data, from->data, BSIZE);
+    bufs[tail+1]->valid = 1;
     brelse(from);
-    brelse(to);
+    sum = cksum(sum, bufs[tail+1]->data);
+  }
+  lc->sum = sum;
+
+  bwritev(bufs, log.lh.n + 1);
+  for (tail = 0; tail <= log.lh.n; tail++)
+    brelse(bufs[tail]);
+}
+
+// Hand the just-committed transaction's blocks to checkpoint(),
+// which needs only one pin on each.
+static void
+defer_install(void)
+{
+  int i, j;
+
+  for (i = 0; i < log.lh.n; i++) {
+    for (j = 0; j < log.nck; j++)
+      if (log.ckblock[j] == log.lh.block[i])
+        break;
+    if (j < log.nck) {
+      // already waiting; drop the extra pin.
+      struct buf *b = bread(log.dev, log.lh.block[i]);
+      bunpin(b);
+      brelse(b);
+    } else {
+      log.ckblock[log.nck++] = log.lh.block[i];
+    }
+  }
+}
+
+// Install every committed transaction at its home location
+// and empty the log.
+static void
+checkpoint(void)
+{
+  static struct buf *bufs[2*LOGSIZE];  // only one commit at a time
+  int i;
+
+  for (i = 0; i < log.nck; i++)
+    bufs[i] = bread(log.dev, log.ckblock[i]); // pinned, so cached
+  bwritev(bufs, log.nck);
+  for (i = 0; i < log.nck; i++) {
+    bunpin(bufs[i]);
+    brelse(bufs[i]);
   }
+  log.nck = 0;
+  log.tail = (log.tail + log.used) % (log.size - 1);
+  log.used = 0;
+  write_super();
 }
 
 static void
 commit()
 {
+  uint64 start = r_time();
+  int n = log.lh.n;
+
   if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+    write_log();     // Write the transaction to the log -- the real commit
+    log.used += log.lh.n + 1;
+    log.seq++;
+    defer_install();
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    // install now if the log could not take another full
+    // transaction, or too many blocks are pinned in the cache.
+    if (log.size - 1 - log.used < log.max + 1 || log.nck > LOGSIZE)
+      checkpoint();
+    trace(TR_LOG_COMMIT, n, r_time() - start);
   }
 }
 
@@ -217,7 +396,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.max)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
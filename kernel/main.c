@@ -12,7 +12,7 @@ main()
 {
   if(cpuid() == 0){
     consoleinit();
-    printfinit();
+    kloginit();      // kernel log
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
@@ -20,13 +20,18 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    mmrlistinit();   // lists of processes sharing mmap regions
     trapinit();      // trap vectors
+    wheelinit();     // sleeping timers
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    dcacheinit();    // directory name cache
+    textcacheinit(); // shared pages of executables
     fileinit();      // file table
+    traceinit();     // event tracing
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     seminit();       // semaphore table
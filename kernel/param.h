@@ -1,15 +1,25 @@
 #define NSEM 100  // maximum open semaphores per system
-#define NPROC        64  // maximum number of processes
+#define NPROC       512  // maximum number of processes
+#define NPROCINIT    64  // processes in the static table; more are kalloc'd
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define ALLCPUS      ((1 << NCPU) - 1)  // affinity mask of every CPU
+#define NOFILE       64  // open files per process
+#define NFILE       100  // initial number of open files per system
+#define NINODE       50  // initial number of in-core i-nodes
+#define NDCACHE     128  // directory name cache entries
+#define NTEXTPAGE   256  // cached pages of executables
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXSEG        4  // max loadable segments per executable
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*6)  // max data blocks in one log transaction
+#define LOGBLOCKS    (LOGSIZE*4)      // default size of on-disk log, set by mkfs
+#define NBUF         (LOGSIZE*3+MAXOPBLOCKS*2)  // size of disk block cache
+#define FSSIZE       20000 // size of file system in blocks
+#define MAXREADAHEAD 8     // max blocks read ahead of a sequential reader
 #define MAXPATH      128   // maximum file path name
+#define MAXIOV       16    // max buffers for one readv or writev
+#define TIMERINTERVAL 1000000 // mtime cycles between clock interrupts
+#define NSYSCALL     64    // size of per-syscall statistics tables
 #define MAX_MMR	10   // maximum number of memory-mapped regions per process //HOMEWORK 5, mmap and munmap
@@ -1,5 +1,6 @@
 //
-// formatted console output -- printf, panic.
+// formatted console output -- printf, panic --
+// and the kernel log -- klog.
 //
 
 #include <stdarg.h>
@@ -14,19 +15,58 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "klog.h"
 
 volatile int panicked = 0;
 
-// lock to avoid interleaving concurrent printf's.
+// Each CPU formats a printf() into a buffer of its own, with
+// interrupts off, then hands the whole of it to the UART's
+// output buffer at once.  So concurrent printf()s neither
+// interleave nor wait for one another, or for the UART to send
+// their output, which the UART interrupt does later.  A printf()
+// longer than PRBUFSIZE goes out in pieces.  After a panic,
+// output is written synchronously instead.
+#define PRBUFSIZE 256
+
 static struct {
-  struct spinlock lock;
-  int locking;
-} pr;
+  char buf[PRBUFSIZE];
+  int n;
+} prbuf[NCPU];
+
+static volatile int prsync;  // set by panic()
+
+// Send this CPU's buffered output.
+// Interrupts must be disabled.
+static void
+prflush(void)
+{
+  int i;
+
+  i = cpuid();
+  if(prbuf[i].n > 0)
+    uartwrite(prbuf[i].buf, prbuf[i].n, 0);
+  prbuf[i].n = 0;
+}
+
+static void
+prputc(int c)
+{
+  int i;
+
+  if(prsync){
+    uartputc_sync(c);
+    return;
+  }
+  i = cpuid();
+  prbuf[i].buf[prbuf[i].n++] = c;
+  if(prbuf[i].n == PRBUFSIZE)
+    prflush();
+}
 
 static char digits[] = "0123456789abcdef";
 
 static void
-printint(int xx, int base, int sign)
+printint(void (*putc)(int), int xx, int base, int sign)
 {
   char buf[16];
   int i;
@@ -46,38 +86,30 @@ printint(int xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    putc(buf[i]);
 }
 
 static void
-printptr(uint64 x)
+printptr(void (*putc)(int), uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  putc('0');
+  putc('x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the console. only understands %d, %x, %p, %s.
-void
-printf(char *fmt, ...)
+// Format fmt and its arguments, one character at a time, with
+// putc. only understands %d, %x, %p, %s.
+static void
+vprintfmt(void (*putc)(int), char *fmt, va_list ap)
 {
-  va_list ap;
-  int i, c, locking;
+  int i, c;
   char *s;
 
-  locking = pr.locking;
-  if(locking)
-    acquire(&pr.lock);
-
-  if (fmt == 0)
-    panic("null fmt");
-
-  va_start(ap, fmt);
   for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
     if(c != '%'){
-      consputc(c);
+      putc(c);
       continue;
     }
     c = fmt[++i] & 0xff;
@@ -85,39 +117,66 @@ printf(char *fmt, ...)
       break;
     switch(c){
     case 'd':
-      printint(va_arg(ap, int), 10, 1);
+      printint(putc, va_arg(ap, int), 10, 1);
       break;
     case 'x':
-      printint(va_arg(ap, int), 16, 1);
+      printint(putc, va_arg(ap, int), 16, 1);
       break;
     case 'p':
-      printptr(va_arg(ap, uint64));
+      printptr(putc, va_arg(ap, uint64));
       break;
     case 's':
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        putc(*s);
       break;
     case '%':
-      consputc('%');
+      putc('%');
       break;
     default:
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c);
+      putc('%');
+      putc(c);
       break;
     }
   }
+}
+
+// Print to the console.
+void
+printf(char *fmt, ...)
+{
+  va_list ap;
+
+  // stay on this CPU, with its buffer to ourselves.
+  push_off();
 
-  if(locking)
-    release(&pr.lock);
+  if (fmt == 0)
+    panic("null fmt");
+
+  va_start(ap, fmt);
+  vprintfmt(prputc, fmt, ap);
+  va_end(ap);
+  prflush();
+  pop_off();
 }
 
 void
 panic(char *s)
 {
-  pr.locking = 0;
+  int i, j;
+
+  // send what is already buffered, including this CPU's
+  // part of a printf(), then write directly.
+  push_off();
+  prsync = 1;
+  uartflush_sync();
+  i = cpuid();
+  for(j = 0; j < prbuf[i].n; j++)
+    uartputc_sync(prbuf[i].buf[j]);
+  prbuf[i].n = 0;
+
   printf("panic: ");
   printf(s);
   printf("\n");
@@ -126,9 +185,114 @@ panic(char *s)
     ;
 }
 
+// The kernel log keeps the last NKLOG messages, each with a
+// sequence number, so that a reader can tell where it left off
+// and whether messages were lost before it read them.  klog()
+// formats a message in its CPU's staging record, with
+// interrupts off, and holds klogring.lock only to number the
+// record and copy it into the ring.  It also copies the message
+// to the console, if the UART's output buffer has room; a CPU
+// never waits for the console to log.
+static struct {
+  struct spinlock lock;
+  uint seq;                   // the last message's
+  struct klogrec rec[NKLOG];  // message seq is in rec[seq % NKLOG]
+} klogring;
+
+static struct klogrec klogstage[NCPU];
+
+void
+kloginit(void)
+{
+  initlock(&klogring.lock, "klog");
+}
+
+static void
+klogputc(int c)
+{
+  struct klogrec *r = &klogstage[cpuid()];
+
+  // leave room for the console's newline.
+  if(r->len < KLOGTEXT - 1)
+    r->text[r->len++] = c;
+}
+
+// Log a one-line message, given without its newline.
 void
-printfinit(void)
+klog(char *fmt, ...)
 {
-  initlock(&pr.lock, "pr");
-  pr.locking = 1;
+  va_list ap;
+  struct klogrec *r;
+
+  push_off();
+  r = &klogstage[cpuid()];
+  r->len = 0;
+  va_start(ap, fmt);
+  vprintfmt(klogputc, fmt, ap);
+  va_end(ap);
+  r->cpu = cpuid();
+  r->ticks = ticks;
+
+  acquire(&klogring.lock);
+  r->seq = ++klogring.seq;
+  klogring.rec[r->seq % NKLOG] = *r;
+  release(&klogring.lock);
+
+  r->text[r->len] = '\n';
+  uarttrywrite(r->text, r->len + 1);
+  pop_off();
+}
+
+// Whether a message limited by rl may be logged now.  Logs how
+// many rl suppressed when the interval they were in is over.
+int
+ratelimit(struct ratelimit *rl)
+{
+  int ok, missed;
+
+  missed = 0;
+  acquire(&klogring.lock);
+  if(rl->n == 0 || ticks - rl->begin >= RATEINTERVAL){
+    missed = rl->missed;
+    rl->begin = ticks;
+    rl->n = 0;
+    rl->missed = 0;
+  }
+  if((ok = rl->n < RATEBURST) != 0)
+    rl->n++;
+  else
+    rl->missed++;
+  release(&klogring.lock);
+
+  if(missed)
+    klog("%s: %d messages suppressed", rl->name, missed);
+  return ok;
+}
+
+// Copy out to dst up to n records of the messages numbered seq
+// and later that the log still has, oldest first.  Returns the
+// number copied, or -1.
+int
+klogread(uint seq, uint64 dst, int n)
+{
+  struct klogrec r;
+  int i;
+
+  for(i = 0; i < n; i++){
+    acquire(&klogring.lock);
+    if(klogring.seq >= NKLOG && seq <= klogring.seq - NKLOG)
+      seq = klogring.seq - NKLOG + 1;  // older ones are gone
+    if(seq == 0)
+      seq = 1;
+    if(seq > klogring.seq){
+      release(&klogring.lock);
+      break;
+    }
+    r = klogring.rec[seq % NKLOG];
+    release(&klogring.lock);
+    if(copyout(myproc()->pagetable, dst + i * sizeof(r), (char*)&r, sizeof(r)) < 0)
+      return -1;
+    seq++;
+  }
+  return i;
 }
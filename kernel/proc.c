@@ -6,18 +6,97 @@
 #include "proc.h"
 #include "defs.h"
 #include "stat.h"
+#include "trace.h"
+#include "vdso.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+struct proc proc[NPROCINIT];
+
+// Every proc structure is on the all list, which grows at the
+// front.  The static ones in proc[] are never freed; while unused
+// they wait on the free list.  When that is empty allocproc()
+// kalloc's another, with its kernel stack, up to NPROC in all,
+// and procput() frees it again when its process is reaped.
+struct {
+  struct spinlock lock;    // protects the lists and n
+  struct proc *all;
+  struct proc *free;
+  int n;                   // kalloc'd proc structures
+} ptable;
+
+// Most scans of the all list hold no lock on it, and some, like
+// the scheduler's, hold no lock at all.  A kalloc'd proc is taken
+// off the list before it is freed, but a scan that began earlier
+// may still be looking at it.  So scans run between walkbegin()
+// and walkend(), with interrupts off, and procput() waits in
+// walksync() for every scan that might have seen the proc to end
+// before it frees it.  A scan must not sleep or yield.
+static volatile uint walkepoch;
+static volatile int walkers[2];  // scans begun in even, odd epochs
 
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// CPUs waiting in cpuidle() for something to run, one bit each.
+static volatile uint idlecpus;
+
+// The scheduler runs the RUNNABLE process with the least
+// vruntime: its running time, scaled by the weight of its nice
+// value.  Each step of nice is about 10% more or less CPU time
+// than a process competing at the next step.
+static const uint niceweight[NICE_MAX - NICE_MIN + 1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+#define NICE0WEIGHT 1024
+
+// About the least vruntime of any RUNNABLE process.  A process
+// that wakes up starts no further behind this than WAKEBONUS,
+// so that it is soon run but cannot bank its sleep.  kick() has
+// a waking process preempt one that is more than WAKEUPGRAN
+// ahead of it.
+static uint64 minvruntime;
+#define WAKEBONUS  TIMERINTERVAL
+#define WAKEUPGRAN (TIMERINTERVAL / 10)
+
+// A process counts as this much further behind on the CPU it
+// last ran on, whose caches and TLB may still hold its state.
+#define MIGRATECOST (TIMERINTERVAL / 20)
+
+// CPUs that have started scheduling, one bit each.
+static volatile uint onlinecpus;
+
+// Sleeping processes, in queues hashed by the channel they sleep
+// on, so that wakeup() looks only at processes that might be
+// sleeping on its channel.  A queue's lock is acquired before the
+// p->lock of any process on it.
+#define NWAITQ 61
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;       // in the order they went to sleep
+  struct proc **tail;
+} waitq[NWAITQ];
+
+#define WAITQ(chan) (&waitq[((uint64)(chan) >> 3) % NWAITQ])
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void idle(void);
+static void startrun(struct proc *p);
+static void stoprun(struct proc *p);
+static void makerunnable(struct proc *p);
+static void dequeue(struct waitq *wq, struct proc *p);
+static void procput(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -27,19 +106,26 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Homework 5: array of locks for mmr_list entries
-struct mmr_list mmr_list[NPROC*MAX_MMR];
+// Homework 5: mmr_list entries, with their locks, in pages
+// allocated as they are needed.  Unused ones are on a free list.
+#define MMRPERPAGE (PGSIZE / sizeof(struct mmr_list))
+#define NMMRLIST   (NPROC*MAX_MMR)
+#define MMRLIST(id) (&mmr_pages[(id) / MMRPERPAGE][(id) % MMRPERPAGE])
+struct mmr_list *mmr_pages[(NMMRLIST + MMRPERPAGE - 1) / MMRPERPAGE];
+int nmmr_list;      // entries in mmr_pages so far
+int mmr_free;       // first unused listid, or -1
 struct spinlock listid_lock;
-// END Homework 5: array of locks for mmr_list entries
+// END Homework 5: mmr_list entries
 
-// Allocate a page for each process's kernel stack.
+// Allocate a page for each static proc's kernel stack.
 // Map it high in memory, followed by an invalid
-// guard page.
+// guard page.  The proc structures allocproc() adds
+// use a kalloc'd page through the direct map instead.
 void
 proc_mapstacks(pagetable_t kpgtbl) {
   struct proc *p;
   
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = proc; p < &proc[NPROCINIT]; p++) {
     char *pa = kalloc();
     if(pa == 0)
       panic("kalloc");
@@ -53,12 +139,26 @@ void
 procinit(void)
 {
   struct proc *p;
+  struct waitq *wq;
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
+  initlock(&ptable.lock, "ptable");
+  for(p = &proc[NPROCINIT-1]; p >= proc; p--) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
+      p->allnext = ptable.all;
+      p->allprev = &ptable.all;
+      if(ptable.all)
+        ptable.all->allprev = &p->allnext;
+      ptable.all = p;
+      p->freenext = ptable.free;
+      ptable.free = p;
+  }
+  for(wq = waitq; wq < &waitq[NWAITQ]; wq++) {
+    initlock(&wq->lock, "waitq");
+    wq->head = 0;
+    wq->tail = &wq->head;
   }
 }
 
@@ -103,41 +203,174 @@ allocpid() {
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
+// Begin a scan of the all list.  Returns the epoch to pass to
+// walkend().
+static uint
+walkbegin(void)
+{
+  uint e;
+
+  push_off();
+  for(;;){
+    e = walkepoch;
+    __sync_fetch_and_add(&walkers[e & 1], 1);
+    // a walksync() that moved on from e before the count went
+    // up would not wait for this scan; count it in the new epoch.
+    if(walkepoch == e)
+      break;
+    __sync_fetch_and_sub(&walkers[e & 1], 1);
+  }
+  __sync_synchronize();
+  return e;
+}
+
+static void
+walkend(uint e)
+{
+  __sync_fetch_and_sub(&walkers[e & 1], 1);
+  pop_off();
+}
+
+// Wait until every scan that began before the call has ended.
+// Caller holds ptable.lock, and is not in a scan.
+static void
+walksync(void)
+{
+  uint e;
+
+  e = walkepoch;
+  __sync_synchronize();
+  walkepoch = e + 1;
+  __sync_synchronize();
+  while(walkers[e & 1] != 0)
+    ;
+}
+
+// procgrow() and allocproc() kalloc a page for each of these.
+_Static_assert(sizeof(struct proc) <= PGSIZE, "struct proc must fit in a page");
+_Static_assert(sizeof(struct procstats) <= PGSIZE, "struct procstats must fit in a page");
+
+// Add a kalloc'd proc structure, with a kernel stack, to the all
+// list, if NPROC allows.  It is UNUSED and not on the free list.
+static struct proc*
+procgrow(void)
+{
+  struct proc *p;
+  char *stack;
+
+  acquire(&ptable.lock);
+  if(NPROCINIT + ptable.n >= NPROC){
+    release(&ptable.lock);
+    return 0;
+  }
+  ptable.n++;
+  release(&ptable.lock);
+
+  p = 0;
+  stack = 0;
+  if((p = (struct proc*)kalloc()) == 0 || (stack = kalloc()) == 0){
+    if(p)
+      kfree(p);
+    acquire(&ptable.lock);
+    ptable.n--;
+    release(&ptable.lock);
+    return 0;
+  }
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  p->kstack = (uint64)stack;
+
+  acquire(&ptable.lock);
+  p->allnext = ptable.all;
+  p->allprev = &ptable.all;
+  if(ptable.all)
+    ptable.all->allprev = &p->allnext;
+  // p must look UNUSED to scans that reach it.
+  __sync_synchronize();
+  ptable.all = p;
+  release(&ptable.lock);
+  return p;
+}
+
+// Give back p, which freeproc() has made UNUSED, after its lock
+// has been released.  Must not be called in a scan.
+static void
+procput(struct proc *p)
+{
+  acquire(&ptable.lock);
+  if(p >= proc && p < &proc[NPROCINIT]){
+    p->freenext = ptable.free;
+    ptable.free = p;
+    release(&ptable.lock);
+    return;
+  }
+  *p->allprev = p->allnext;
+  if(p->allnext)
+    p->allnext->allprev = p->allprev;
+  ptable.n--;
+  walksync();
+  release(&ptable.lock);
+  kfree((void*)p->kstack);
+  kfree(p);
+}
+
+// Take an UNUSED proc from the free list, or make one.
+// Initialize state required to run in the kernel,
 // and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// If there are NPROC procs, or a memory allocation fails, return 0.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  acquire(&ptable.lock);
+  if((p = ptable.free) != 0)
+    ptable.free = p->freenext;
+  release(&ptable.lock);
+  if(p == 0 && (p = procgrow()) == 0)
+    return 0;
+  acquire(&p->lock);
 
-found:
   p->pid = allocpid();
   p->state = USED;
+  memset(&p->sched, 0, sizeof(p->sched));
+  p->sched.vruntime = minvruntime;
+  p->affinity = ALLCPUS;
+  p->lastcpu = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
     release(&p->lock);
+    procput(p);
+    return 0;
+  }
+
+  // Allocate the page user code reads kernel data from.
+  if((p->vdso = (struct vdso *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    procput(p);
     return 0;
   }
+  memset(p->vdso, 0, PGSIZE);
+  p->vdso->pid = p->pid;
+
+  // Allocate a page for system call statistics.
+  if((p->stats = (struct procstats *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    procput(p);
+    return 0;
+  }
+  memset(p->stats, 0, sizeof(*p->stats));
 
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
     freeproc(p);
     release(&p->lock);
+    procput(p);
     return 0;
   }
 
@@ -150,16 +383,12 @@ found:
   return p;
 }
 
-// free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
-static void
-freeproc(struct proc *p)
+// Unmap all of p's mmap()'d regions, including its submission
+// ring, from p->pagetable, freeing the pages no other process
+// shares.  Called when p exits and when it execs a new image.
+void
+mmrfree(struct proc *p)
 {
-  if(p->trapframe)
-    kfree((void*)p->trapframe);
-  p->trapframe = 0;
-    // --- BEGIN: mmap region cleanup ---
   for (int i = 0; i < MAX_MMR; i++) {
     int dofree = 0;
 
@@ -169,7 +398,7 @@ freeproc(struct proc *p)
         dofree = 1;
       } else { // MAP_SHARED
         // check if this is the last process sharing the region
-        struct mmr_list *lst = &mmr_list[p->mmr[i].mmr_family.listid];
+        struct mmr_list *lst = get_mmr_list(p->mmr[i].mmr_family.listid);
         acquire(&lst->lock);
         if (p->mmr[i].mmr_family.next == &p->mmr[i].mmr_family) {
           // no one else in the family: free frames and listid
@@ -196,7 +425,26 @@ freeproc(struct proc *p)
       p->mmr[i].valid = 0;  // mark region invalid for this process
     }
   }
-  // --- END: mmap region cleanup ---
+  p->ring = 0;
+  p->cur_max = VDSO;
+}
+
+// free a proc structure and the data hanging from it,
+// including user pages.
+// p->lock must be held.
+static void
+freeproc(struct proc *p)
+{
+  if(p->trapframe)
+    kfree((void*)p->trapframe);
+  p->trapframe = 0;
+  if(p->vdso)
+    kfree((void*)p->vdso);
+  p->vdso = 0;
+  if(p->stats)
+    kfree((void*)p->stats);
+  p->stats = 0;
+  mmrfree(p);
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
@@ -207,6 +455,8 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->ring = 0;
+  p->nseg = 0;
   p->state = UNUSED;
 }
 
@@ -240,6 +490,15 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the vdso page just below TRAPFRAME, readable by the user.
+  if(mappages(pagetable, VDSO, PGSIZE,
+              (uint64)(p->vdso), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -250,6 +509,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -286,12 +546,22 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
-  p->cur_max = MAXVA - 2 * PGSIZE;; // initialize cur_max
+  makerunnable(p);
+  p->cur_max = VDSO; // initialize cur_max
 
   release(&p->lock);
 }
 
+// Refresh the fields of p's vdso page that change while it
+// runs.  Called on the CPU that is about to run, or is running, p.
+void
+vdsoupdate(struct proc *p)
+{
+  p->vdso->ticks = ticks;
+  p->vdso->cpu = cpuid();
+  p->vdso->freepages = kfreepages_count();
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -330,6 +600,7 @@ fork(void)
   if(uvmcopy(p->pagetable, np->pagetable, 0, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
+    procput(np);
     return -1;
   }
   np->sz = p->sz;
@@ -347,9 +618,13 @@ fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->sched.nice = p->sched.nice;
+  np->affinity = p->affinity;
+  np->lastcpu = p->lastcpu;
 
   pid = np->pid;
   np->cur_max = p->cur_max;
+  np->ring = p->ring;
 
     // ----- BEGIN: copy mmr table from parent to child -----
 
@@ -370,6 +645,7 @@ fork(void)
           if (uvmcopy(p->pagetable, np->pagetable, addr, addr + PGSIZE) < 0) {
             freeproc(np);
             release(&np->lock);
+            procput(np);
             return -1;
           }
         }
@@ -390,6 +666,7 @@ fork(void)
           if (uvmcopyshared(p->pagetable, np->pagetable, addr, addr + PGSIZE) < 0) {
             freeproc(np);
             release(&np->lock);
+            procput(np);
             return -1;
           }
         }
@@ -399,7 +676,7 @@ fork(void)
       np->mmr[i].mmr_family.proc   = np;
       np->mmr[i].mmr_family.listid = p->mmr[i].mmr_family.listid;
 
-      struct mmr_list *lst = &mmr_list[np->mmr[i].mmr_family.listid];
+      struct mmr_list *lst = get_mmr_list(np->mmr[i].mmr_family.listid);
       acquire(&lst->lock);
 
       // Insert child right after parent in the circular doubly-linked list
@@ -414,6 +691,12 @@ fork(void)
 
   // ----- END: copy mmr table from parent to child -----
 
+  // pages the parent has not touched yet come from the same file.
+  if(p->exe)
+    np->exe = idup(p->exe);
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
+
 
   release(&np->lock);
 
@@ -422,8 +705,9 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  makerunnable(np);
   release(&np->lock);
+  kick(np);
 
   return pid;
 }
@@ -434,13 +718,16 @@ void
 reparent(struct proc *p)
 {
   struct proc *pp;
+  uint e;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
+  e = walkbegin();
+  for(pp = ptable.all; pp; pp = pp->allnext){
     if(pp->parent == p){
       pp->parent = initproc;
       wakeup(initproc);
     }
   }
+  walkend(e);
 }
 
 // Exit the current process.  Does not return.
@@ -465,8 +752,11 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exe)
+    iput(p->exe);
   end_op();
   p->cwd = 0;
+  p->exe = 0;
 
   acquire(&wait_lock);
 
@@ -496,13 +786,19 @@ wait(uint64 addr)
   struct proc *np;
   int havekids, pid;
   struct proc *p = myproc();
+  uint e;
+
+  // copyout() below runs with locks held; see vmprefault().
+  if(addr != 0 && vmprefault(addr, sizeof(int)) < 0)
+    return -1;
 
   acquire(&wait_lock);
 
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
+    e = walkbegin();
+    for(np = ptable.all; np; np = np->allnext){
       if(np->parent == p){
         // make sure the child isn't still in exit() or swtch().
         acquire(&np->lock);
@@ -514,17 +810,23 @@ wait(uint64 addr)
           if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
                                   sizeof(np->xstate)) < 0) {
             release(&np->lock);
+            walkend(e);
             release(&wait_lock);
             return -1;
           }
+          sysstat_merge(p->stats->csysstat, np->stats->sysstat);
+          sysstat_merge(p->stats->csysstat, np->stats->csysstat);
           freeproc(np);
           release(&np->lock);
+          walkend(e);
           release(&wait_lock);
+          procput(np);
           return pid;
         }
         release(&np->lock);
       }
     }
+    walkend(e);
 
     // No point waiting if we don't have any children.
     if(!havekids || p->killed){
@@ -547,31 +849,182 @@ wait(uint64 addr)
 void
 scheduler(void)
 {
-  struct proc *p;
+  struct proc *p, *best;
   struct cpu *c = mycpu();
+  uint64 key, bestkey;
+  int id = cpuid();
+  uint e;
   
   c->proc = 0;
+  __sync_fetch_and_or(&onlinecpus, 1 << id);
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+    // find the RUNNABLE process allowed on this CPU with the least
+    // vruntime, favouring those that last ran here, without
+    // taking every lock; check it again once it is locked.
+    best = 0;
+    bestkey = 0;
+    e = walkbegin();
+    for(p = ptable.all; p; p = p->allnext) {
+      if(p->state != RUNNABLE || (p->affinity & (1 << id)) == 0)
+        continue;
+      key = p->sched.vruntime;
+      if(p->lastcpu != id)
+        key += MIGRATECOST;
+      if(best == 0 || key < bestkey){
+        best = p;
+        bestkey = key;
       }
+    }
+    if(best == 0){
+      walkend(e);
+      idle();
+      continue;
+    }
+
+    // p may have been reaped since the scan, and stays
+    // in memory only until the scan ends.  Once it is seen
+    // to be RUNNABLE, its lock keeps it.
+    p = best;
+    acquire(&p->lock);
+    if(p->state == RUNNABLE && (p->affinity & (1 << id)) != 0) {
+      walkend(e);
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      p->lastcpu = id;
+      c->proc = p;
+      c->resched = 0;
+      startrun(p);
+      vdsoupdate(p);
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      stoprun(p);
+      c->proc = 0;
+      release(&p->lock);
+    } else {
       release(&p->lock);
+      walkend(e);
+    }
+  }
+}
+
+// p is about to run: account for its wait.
+// Caller holds p->lock.
+static void
+startrun(struct proc *p)
+{
+  uint64 now, wait;
+
+  now = r_time();
+  wait = now - p->since;
+  p->since = now;
+  p->sched.nrun++;
+  p->sched.waittime += wait;
+  if(wait > p->sched.maxwait)
+    p->sched.maxwait = wait;
+  if(p->sched.vruntime > minvruntime)
+    minvruntime = p->sched.vruntime;
+  trace(TR_SCHED_IN, p->pid, wait);
+}
+
+// p has stopped running: charge it for the time it ran.
+// Caller holds p->lock.
+static void
+stoprun(struct proc *p)
+{
+  uint64 now, ran;
+
+  now = r_time();
+  ran = now - p->since;
+  p->since = now;
+  p->sched.runtime += ran;
+  p->sched.vruntime += ran * NICE0WEIGHT / niceweight[p->sched.nice - NICE_MIN];
+}
+
+// Make p RUNNABLE after it was created or slept.
+// Caller holds p->lock.
+static void
+makerunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  p->since = r_time();
+  if(p->sched.vruntime + WAKEBONUS < minvruntime)
+    p->sched.vruntime = minvruntime - WAKEBONUS;
+}
+
+// Nothing was runnable: wait in cpuidle() until an interrupt,
+// perhaps an IPI from kick(), says there may be.
+static void
+idle(void)
+{
+  struct proc *p;
+  uint bit, e;
+
+  intr_off();
+  bit = 1 << cpuid();
+  __sync_fetch_and_or(&idlecpus, bit);
+
+  // a process made RUNNABLE after the scan above, but before
+  // idlecpus said this CPU is idle, sent no IPI; look again.
+  __sync_synchronize();
+  e = walkbegin();
+  for(p = ptable.all; p; p = p->allnext)
+    if(p->state == RUNNABLE && (p->affinity & bit) != 0)
+      break;
+  walkend(e);
+  if(p == 0)
+    cpuidle();
+
+  __sync_fetch_and_and(&idlecpus, ~bit);
+}
+
+// p has become RUNNABLE.  Send an IPI to an idle CPU it may run
+// on, if there is one, to run it, preferring the CPU it last
+// ran on; if not, have a CPU running a process well ahead of p
+// in vruntime yield to it.  The caller must keep p from being
+// freed, by holding it in a scan if p could be reaped meanwhile.
+void
+kick(struct proc *p)
+{
+  struct cpu *c;
+  struct proc *q;
+  uint mask, idle, e;
+  int id;
+
+  __sync_synchronize();
+  while((mask = idlecpus) != 0 && (idle = mask & p->affinity) != 0){
+    if(idle & (1 << p->lastcpu))
+      id = p->lastcpu;
+    else
+      for(id = 0; (idle & (1 << id)) == 0; id++)
+        ;
+    // claim the CPU, so that the next kick() picks another.
+    if(__sync_bool_compare_and_swap(&idlecpus, mask, mask & ~(1 << id))){
+      ipi(id);
+      return;
     }
   }
+
+  // another CPU's process may exit and be reaped meanwhile.
+  e = walkbegin();
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    q = c->proc;
+    if((p->affinity & (1 << (c - cpus))) == 0)
+      continue;
+    if(q != 0 && q != p && c->resched == 0 &&
+       q->sched.vruntime > p->sched.vruntime + WAKEUPGRAN){
+      c->resched = 1;
+      ipi(c - cpus);
+      break;
+    }
+  }
+  walkend(e);
 }
 
 // Switch to scheduler.  Must hold only p->lock
@@ -596,6 +1049,7 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  trace(TR_SCHED_OUT, p->pid, p->state);
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
@@ -608,6 +1062,10 @@ yield(void)
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
+  // if setaffinity() moved p off this CPU, another must be
+  // told to run it: the ones it may use could all be idle.
+  if((p->affinity & (1 << cpuid())) == 0)
+    kick(p);
   sched();
   release(&p->lock);
 }
@@ -639,47 +1097,106 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = WAITQ(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we hold chan's wait queue lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks the queue),
   // so it's okay to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wnext = 0;
+  p->wprev = wq->tail;
+  *wq->tail = p;
+  wq->tail = &p->wnext;
+  release(&wq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // wakeup() took p off the queue, unless kill() woke it.
+  acquire(&wq->lock);
+  if(p->wprev)
+    dequeue(wq, p);
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
+// Take p off wait queue wq.
+// Caller holds wq->lock.
+static void
+dequeue(struct waitq *wq, struct proc *p)
+{
+  *p->wprev = p->wnext;
+  if(p->wnext)
+    p->wnext->wprev = p->wprev;
+  else
+    wq->tail = p->wprev;
+  p->wnext = 0;
+  p->wprev = 0;
+}
+
+// Wake processes sleeping on chan, in the order they went to
+// sleep: all of them, or only the first if one is set.
+static void
+wakeupn(void *chan, int one)
+{
+  struct waitq *wq = WAITQ(chan);
+  struct proc *p, *next;
+  int woke;
+  uint e;
+
+  // a woken process may run, exit and be reaped before kick().
+  e = walkbegin();
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = next){
+    next = p->wnext;
+    if(p->chan != chan)
+      continue;   // another channel in the same queue
+    acquire(&p->lock);
+    if((woke = p->state == SLEEPING && p->chan == chan) != 0){
+      dequeue(wq, p);
+      makerunnable(p);
+    }
+    release(&p->lock);
+    if(woke){
+      kick(p);
+      if(one)
+        break;
+    }
+  }
+  release(&wq->lock);
+  walkend(e);
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wakeupn(chan, 0);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-    }
-  }
+// Wake up the process that has slept longest on chan, for
+// callers that know one waiter can use what they provide.
+// Must be called without any p->lock.
+void
+wakeup_one(void *chan)
+{
+  wakeupn(chan, 1);
 }
 
 // Kill the process with the given pid.
@@ -689,20 +1206,143 @@ int
 kill(int pid)
 {
   struct proc *p;
+  uint e;
 
-  for(p = proc; p < &proc[NPROC]; p++){
+  e = walkbegin();
+  for(p = ptable.all; p; p = p->allnext){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        makerunnable(p);
+        kick(p);
+      }
+      release(&p->lock);
+      walkend(e);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  walkend(e);
+  return -1;
+}
+
+// Set the nice value of the process with the given pid, or of
+// the caller if pid is 0.
+int
+setnice(int pid, int nice)
+{
+  struct proc *p;
+  uint e;
+
+  if(nice < NICE_MIN || nice > NICE_MAX)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  e = walkbegin();
+  for(p = ptable.all; p; p = p->allnext){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->sched.nice = nice;
+      release(&p->lock);
+      walkend(e);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  walkend(e);
+  return -1;
+}
+
+// Let the process with the given pid, or the caller if pid is
+// 0, run only on the CPUs in mask, which must include one that
+// is running.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+  int id, moved;
+  uint e;
+
+  if((mask & onlinecpus) == 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  e = walkbegin();
+  for(p = ptable.all; p; p = p->allnext){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->affinity = mask & ALLCPUS;
+      // get a running process off a CPU it may no longer use.
+      moved = p->state == RUNNING && (mask & (1 << p->lastcpu)) == 0;
+      id = p->lastcpu;
+      release(&p->lock);
+      walkend(e);
+      if(moved && p == myproc()){
+        yield();
+      } else if(moved){
+        cpus[id].resched = 1;
+        ipi(id);
       }
+      return 0;
+    }
+    release(&p->lock);
+  }
+  walkend(e);
+  return -1;
+}
+
+// The CPUs the process with the given pid, or the caller if pid
+// is 0, may run on, or -1 if there is no such process.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+  uint e;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  e = walkbegin();
+  for(p = ptable.all; p; p = p->allnext){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      mask = p->affinity;
       release(&p->lock);
+      walkend(e);
+      return mask;
+    }
+    release(&p->lock);
+  }
+  walkend(e);
+  return -1;
+}
+
+// Copy the scheduling statistics of the process with the given
+// pid, or of the caller if pid is 0, to *st.
+int
+getschedstat(int pid, struct schedstat *st)
+{
+  struct proc *p;
+  uint e;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  e = walkbegin();
+  for(p = ptable.all; p; p = p->allnext){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      *st = p->sched;
+      if(p->state == RUNNING)
+        st->runtime += r_time() - p->since;
+      release(&p->lock);
+      walkend(e);
       return 0;
     }
     release(&p->lock);
   }
+  walkend(e);
   return -1;
 }
 
@@ -751,9 +1391,11 @@ procdump(void)
   };
   struct proc *p;
   char *state;
+  uint e;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  e = walkbegin();
+  for(p = ptable.all; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -763,53 +1405,75 @@ procdump(void)
     printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
+  walkend(e);
 }
 
 // HOMEWORK 5, mmap and munmap
+
+// Add a page of mmr_list entries to the free list.
+// Caller holds listid_lock.
+static int
+mmrgrow(void)
+{
+  struct mmr_list *page;
+  int i, n;
+
+  if(nmmr_list >= NMMRLIST || (page = (struct mmr_list*)kalloc()) == 0)
+    return -1;
+  mmr_pages[nmmr_list / MMRPERPAGE] = page;
+  n = NMMRLIST - nmmr_list < MMRPERPAGE ? NMMRLIST - nmmr_list : MMRPERPAGE;
+  for(i = n - 1; i >= 0; i--){
+    initlock(&page[i].lock, "mmrlist");
+    page[i].valid = 0;
+    page[i].nextfree = mmr_free;
+    mmr_free = nmmr_list + i;
+  }
+  nmmr_list += n;
+  return 0;
+}
+
 void
 mmrlistinit(void)
 {
-  struct mmr_list *pmmrlist;
   initlock(&listid_lock,"listid");
-  for (pmmrlist = mmr_list; pmmrlist < &mmr_list[NPROC*MAX_MMR]; pmmrlist++) {
-    initlock(&pmmrlist->lock, "mmrlist");
-    pmmrlist->valid = 0;
-  }
+  mmr_free = -1;
+  if(mmrgrow() < 0)
+    panic("mmrlistinit");
 }
 
 // find the mmr_list for a given listid
 struct mmr_list*
 get_mmr_list(int listid) {
+  struct mmr_list *pmmrlist = 0;
+
   acquire(&listid_lock);
-  if (listid >=0 && listid < NPROC*MAX_MMR && mmr_list[listid].valid) {
-    release(&listid_lock);
-    return(&mmr_list[listid]);
-  }
-  else {
-    release(&listid_lock);
-    return 0;
-  }
+  if (listid >=0 && listid < nmmr_list && MMRLIST(listid)->valid)
+    pmmrlist = MMRLIST(listid);
+  release(&listid_lock);
+  return pmmrlist;
 }
 
 // free up entry in mmr_list array
 void
 dealloc_mmr_listid(int listid) {
   acquire(&listid_lock);
-  mmr_list[listid].valid = 0;
+  MMRLIST(listid)->valid = 0;
+  MMRLIST(listid)->nextfree = mmr_free;
+  mmr_free = listid;
   release(&listid_lock);
 }
 
-// find an unused entry in the mmr_list array
+// take an unused entry off the free list, adding a page of
+// entries if there are none
 int
 alloc_mmr_listid() {
-  acquire(&listid_lock);
   int listid = -1;
-  for (int i = 0; i < NPROC*MAX_MMR; i++) {
-    if (mmr_list[i].valid == 0) {
-      mmr_list[i].valid = 1;
-      listid = i;
-      break;
-    }
+
+  acquire(&listid_lock);
+  if (mmr_free >= 0 || mmrgrow() == 0) {
+    listid = mmr_free;
+    mmr_free = MMRLIST(listid)->nextfree;
+    MMRLIST(listid)->valid = 1;
   }
   release(&listid_lock);
   return(listid);
@@ -1,3 +1,6 @@
+#include "sysstat.h"
+#include "schedstat.h"
+
 // Saved registers for kernel context switches.
 struct context {
   uint64 ra;
@@ -24,6 +27,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 nexttick;            // mtime of this cpu's next clock tick
+  int resched;                // yield at the next interrupt, for kick()
 };
 
 extern struct cpu cpus[NCPU];
@@ -87,6 +92,7 @@ enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 struct mmr_list { 
    struct spinlock lock;
    int valid;
+   int nextfree;   // next unused listid, if this one is unused
 };
 
 // struct for node in list of processes that share a mapped memory region
@@ -111,16 +117,43 @@ struct mmr {
 
 // end of HOMEWORK 5, mmap and munmap
 
+// Part of the executable that exec() left to be read in
+// page by page, on first touch.
+struct execseg {
+  uint64 va;      // page-aligned start
+  uint64 memsz;   // bytes of memory from va
+  uint64 filesz;  // bytes of them that come from the file
+  uint off;       // file offset of va
+};
+
+// A process's system call statistics.  They take a page of their
+// own, which keeps struct proc small enough for procgrow().
+struct procstats {
+  struct sysstat sysstat[NSYSCALL];  // this process's system calls
+  struct sysstat csysstat[NSYSCALL]; // system calls of waited-for children
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
 
+  // the process table's lock must be held when changing these:
+  struct proc *allnext;        // list of every proc structure
+  struct proc **allprev;
+  struct proc *freenext;       // list of unused static ones
+
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *wnext;          // chan's wait queue, whose lock protects these
+  struct proc **wprev;         // 0 if not on one
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  struct schedstat sched;      // Nice value and CPU time accounting
+  uint64 since;                // mtime of the last change to or from RUNNING
+  uint affinity;               // CPUs the process may run on, one bit each
+  int lastcpu;                 // CPU it last ran on
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -130,14 +163,19 @@ struct proc {
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  struct vdso *vdso;           // data page mapped read-only at VDSO
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *exe;           // Executable, for demand paging
+  struct execseg seg[MAXSEG];  // Its segments
+  int nseg;
   char name[16];               // Process name (debugging)
   //HOMEWORK 5, mmap and munmap
   struct mmr mmr[MAX_MMR];     // Array of memory-mapped regions
   uint64 cur_max;              // Max address of free virtual memory, 
-                               // initialize to MAXVA-2*PGSIZE
+                               // initialize to VDSO
   // end of HOMEWORK 5, mmap and munmap
-
+  uint64 ring;                 // Submission ring address, or 0
+  struct procstats *stats;     // System call statistics
 };
@@ -0,0 +1,44 @@
+// Batched system-call submission ring.
+// Both the kernel and user programs use this header file.
+//
+// ring_setup() maps one page holding a submission queue (sq) and
+// a completion queue (cq) into the calling process.  The process
+// fills sq entries and advances sq_tail; ring_enter(n) has the
+// kernel consume up to n of them in order, appending one cq entry
+// per operation.  The process reads completions from cq_head up to
+// cq_tail.  Indices run freely and are taken modulo RING_ENTRIES.
+
+#define RING_ENTRIES 64   // per queue; both queues fit in one page
+
+// Operations, and what each sq entry field means for them.
+#define RING_NOP       0  //
+#define RING_READ      1  // read(fd, addr, n)
+#define RING_WRITE     2  // write(fd, addr, n)
+#define RING_OPEN      3  // open(addr, n)
+#define RING_CLOSE     4  // close(fd)
+#define RING_SEM_WAIT  5  // sem_wait(addr)
+#define RING_SEM_POST  6  // sem_post(addr)
+
+struct ring_sqe {
+  int op;        // RING_xxx
+  int fd;
+  uint64 addr;   // user buffer, path or sem_t
+  int n;         // byte count or open mode
+  int pad;
+  uint64 data;   // passed through to the completion
+};
+
+struct ring_cqe {
+  uint64 data;   // from the sq entry
+  int res;       // what the equivalent system call would return
+  int pad;
+};
+
+struct ring {
+  uint sq_head;  // next entry the kernel consumes; kernel writes
+  uint sq_tail;  // next free entry; user writes
+  uint cq_head;  // next completion the user consumes; user writes
+  uint cq_tail;  // next free completion; kernel writes
+  struct ring_sqe sq[RING_ENTRIES];
+  struct ring_cqe cq[RING_ENTRIES];
+};
@@ -0,0 +1,14 @@
+// Scheduling statistics for one process, as returned by schedstat().
+// Both the kernel and user programs use this header file.
+
+struct schedstat {
+  int nice;         // NICE_MIN (most favoured) .. NICE_MAX
+  uint nrun;        // times the process has been switched to
+  uint64 runtime;   // time spent running, in mtime cycles
+  uint64 vruntime;  // runtime, weighted by nice; the least runs next
+  uint64 waittime;  // time spent RUNNABLE, waiting for a CPU
+  uint64 maxwait;   // longest such wait
+};
+
+#define NICE_MIN  -20
+#define NICE_MAX   19
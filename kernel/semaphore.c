@@ -37,3 +37,40 @@ void semdealloc(int semid) {
   }  
   release(&semtable.lock);
 }
+
+// Decrement semaphore semid, sleeping while it is zero.
+// Returns -1 if semid is not a valid semaphore.
+int
+semwait(int semid)
+{
+  if (semid < 0 || semid >= NSEM || semtable.sem[semid].valid == 0) {
+    return -1;
+  }
+  struct semaphore *s = &semtable.sem[semid];
+  acquire(&s->lock);
+  while (s->count <= 0) {
+    sleep(s, &s->lock); 
+  }
+  
+  s->count--;
+  release(&s->lock);
+  return 0;
+}
+
+// Increment semaphore semid and wake a waiter.
+// Returns -1 if semid is not a valid semaphore.
+int
+sempost(int semid)
+{
+  if (semid < 0 || semid >= NSEM || semtable.sem[semid].valid == 0) {
+    return -1;
+  }
+  
+  struct semaphore *s = &semtable.sem[semid];
+  acquire(&s->lock);
+  s->count++;
+  wakeup_one(s);
+  release(&s->lock);
+  
+  return 0; // Success
+}
@@ -6,6 +6,12 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "trace.h"
+#include "klog.h"
+
+// a program making bad system calls in a loop should not fill
+// the kernel log.
+static struct ratelimit syscalllimit = { "syscall" };
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -111,7 +117,20 @@ extern uint64 sys_sem_init(void);
 extern uint64 sys_sem_destroy(void);
 extern uint64 sys_sem_wait(void);
 extern uint64 sys_sem_post(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_ring_setup(void);
+extern uint64 sys_ring_enter(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
 
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_schedstat(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_klogread(void);
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
 [SYS_exit]    sys_exit,
@@ -141,20 +160,74 @@ static uint64 (*syscalls[])(void) = {
 [SYS_sem_destroy] sys_sem_destroy,
 [SYS_sem_wait] sys_sem_wait,
 [SYS_sem_post] sys_sem_post,
+[SYS_sysstat] sys_sysstat,
+[SYS_ring_setup] sys_ring_setup,
+[SYS_ring_enter] sys_ring_enter,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_setpriority] sys_setpriority,
+[SYS_schedstat] sys_schedstat,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_klogread] sys_klogread,
 };
 
+// system-wide statistics, kept per CPU so that
+// syscall() can update them without a lock.
+static struct sysstat cpusysstat[NCPU][NSYSCALL];
+
+static void
+sysstat_add(struct sysstat *s, uint count, uint64 cycles, uint64 max)
+{
+  s->count += count;
+  s->cycles += cycles;
+  if(max > s->max)
+    s->max = max;
+}
+
+// Add the table src into the table dst.
+void
+sysstat_merge(struct sysstat *dst, struct sysstat *src)
+{
+  for(int i = 0; i < NSYSCALL; i++)
+    sysstat_add(&dst[i], src[i].count, src[i].cycles, src[i].max);
+}
+
+// Sum the system-wide statistics of every CPU into dst.
+void
+sysstat_all(struct sysstat *dst)
+{
+  memset(dst, 0, NSYSCALL*sizeof(struct sysstat));
+  for(int i = 0; i < NCPU; i++)
+    sysstat_merge(dst, cpusysstat[i]);
+}
+
 void
 syscall(void)
 {
   int num;
+  uint64 start, cycles;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    trace(TR_SYSCALL_ENTER, num, 0);
+    start = r_time();
     p->trapframe->a0 = syscalls[num]();
+    cycles = r_time() - start;
+    trace(TR_SYSCALL_EXIT, num, cycles);
+    if(num < NSYSCALL){
+      sysstat_add(&p->stats->sysstat[num], 1, cycles, cycles);
+      push_off();
+      sysstat_add(&cpusysstat[cpuid()][num], 1, cycles, cycles);
+      pop_off();
+    }
   } else {
-    printf("%d %s: unknown sys call %d\n",
-            p->pid, p->name, num);
+    if(ratelimit(&syscalllimit))
+      klog("%d %s: unknown sys call %d", p->pid, p->name, num);
     p->trapframe->a0 = -1;
   }
 }
@@ -27,3 +27,16 @@
 #define SYS_sem_destroy 26
 #define SYS_sem_wait 27
 #define SYS_sem_post 28
+#define SYS_sysstat 29
+#define SYS_ring_setup 30
+#define SYS_ring_enter 31
+#define SYS_pread  32
+#define SYS_pwrite 33
+#define SYS_readv  34
+#define SYS_writev 35
+#define SYS_nanosleep 36
+#define SYS_setpriority 37
+#define SYS_schedstat 38
+#define SYS_sched_setaffinity 39
+#define SYS_sched_getaffinity 40
+#define SYS_klogread 41
@@ -15,6 +15,16 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "ring.h"
+
+// Return the current process's open file for descriptor fd, or 0.
+static struct file*
+fdlookup(int fd)
+{
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  return myproc()->ofile[fd];
+}
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +36,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f=fdlookup(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -91,6 +101,69 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Fetch the iovec array for readv or writev.
+static int
+argiov(struct iovec *iov, int *cnt)
+{
+  uint64 p;
+
+  if(argaddr(1, &p) < 0 || argint(2, cnt) < 0)
+    return -1;
+  if(*cnt < 0 || *cnt > MAXIOV)
+    return -1;
+  return copyin(myproc()->pagetable, (char*)iov, p, *cnt * sizeof(struct iovec));
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &cnt) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &cnt) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
 uint64
 sys_close(void)
 {
@@ -218,6 +291,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcache_enter(dp->dev, dp->inum, name, 0, 0);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -283,17 +357,14 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path with mode omode and return a new file descriptor,
+// or -1.  Shared by open() and the submission ring.
+static int
+openpath(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -336,6 +407,9 @@ sys_open(void)
   } else {
     f->type = FD_INODE;
     f->off = 0;
+    f->ranext = 0;
+    f->rawin = 0;
+    f->raend = 0;
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
@@ -351,6 +425,17 @@ sys_open(void)
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openpath(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -487,15 +572,14 @@ sys_pipe(void)
 
 //HW5 mmap and munmap
 
+static uint64 mmapregion(uint64, int, int);
+
 uint64
 sys_mmap(void)
 {
   uint64 length;
   int    prot;
   int    flags;
-  struct proc *p = myproc();
-  struct mmr *newmmr = 0;
-  uint64 start_addr;
 
   // args: (void *addr, uint length, int prot, int flags, int fd, int offset)
   uint64 addr;
@@ -522,6 +606,20 @@ sys_mmap(void)
   if ((flags & (MAP_PRIVATE | MAP_SHARED)) == 0)
     return -1;
 
+  return mmapregion(length, prot, flags);
+}
+
+// Reserve an anonymous region of length bytes below cur_max in
+// the current process and record it in a free mmr entry.
+// Page-table entries are created but no physical pages.
+// Returns the region's start address, or -1.
+static uint64
+mmapregion(uint64 length, int prot, int flags)
+{
+  struct proc *p = myproc();
+  struct mmr *newmmr = 0;
+  uint64 start_addr;
+
   // find free mmr entry
   for (int i = 0; i < MAX_MMR; i++) {
     if (p->mmr[i].valid == 0) {
@@ -586,6 +684,8 @@ munmap(uint64 addr, uint64 length)
     return -1;
 
   mmr->valid = 0;
+  if (addr == p->ring)
+    p->ring = 0;
 
   if (mmr->flags & MAP_PRIVATE)
     dofree = 1;
@@ -630,4 +730,111 @@ sys_munmap(void)
   return munmap(addr, length);
 }
 
-// end of HW5 mmap and munmap
\ No newline at end of file
+// end of HW5 mmap and munmap
+// Perform one submission-ring operation for the current process
+// and return what the equivalent system call would.
+static int
+ringop(struct ring_sqe *e)
+{
+  struct proc *p = myproc();
+  struct file *f;
+  char path[MAXPATH];
+  int semid;
+
+  switch(e->op){
+  case RING_NOP:
+    return 0;
+  case RING_READ:
+    if((f = fdlookup(e->fd)) == 0 || e->n < 0)
+      return -1;
+    return fileread(f, e->addr, e->n);
+  case RING_WRITE:
+    if((f = fdlookup(e->fd)) == 0 || e->n < 0)
+      return -1;
+    return filewrite(f, e->addr, e->n);
+  case RING_OPEN:
+    if(fetchstr(e->addr, path, MAXPATH) < 0)
+      return -1;
+    return openpath(path, e->n);
+  case RING_CLOSE:
+    if((f = fdlookup(e->fd)) == 0)
+      return -1;
+    p->ofile[e->fd] = 0;
+    fileclose(f);
+    return 0;
+  case RING_SEM_WAIT:
+  case RING_SEM_POST:
+    if(copyin(p->pagetable, (char *)&semid, e->addr, sizeof(semid)) < 0)
+      return -1;
+    return e->op == RING_SEM_WAIT ? semwait(semid) : sempost(semid);
+  }
+  return -1;
+}
+
+// Map a submission ring into the current process.
+// Returns its user address, or -1.  A process has at most one
+// ring; a forked child gets a private copy of its parent's.
+uint64
+sys_ring_setup(void)
+{
+  struct proc *p = myproc();
+  uint64 va;
+  char *mem;
+
+  if(p->ring)
+    return -1;
+  va = mmapregion(PGSIZE, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE);
+  if(va == -1)
+    return -1;
+  // the kernel reads the ring through its physical address,
+  // so back it now rather than on first touch.
+  if((mem = kalloc()) == 0){
+    munmap(va, PGSIZE);
+    return -1;
+  }
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_R | PTE_W | PTE_U) < 0){
+    kfree(mem);
+    munmap(va, PGSIZE);
+    return -1;
+  }
+  p->ring = va;
+  return va;
+}
+
+// Consume up to n submitted entries, in order, posting a
+// completion for each.  Stops early when the submission queue
+// is empty or the completion queue is full.
+// Returns the number of entries consumed.
+uint64
+sys_ring_enter(void)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+  struct ring_sqe e;
+  struct ring_cqe *c;
+  int n, done;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  // the ring page is private to this process and stays mapped
+  // while it runs here, so its physical address is stable.
+  if(p->ring == 0 || (r = (struct ring *)walkaddr(p->pagetable, p->ring)) == 0)
+    return -1;
+
+  for(done = 0; done < n; done++){
+    if(r->sq_head == r->sq_tail || r->cq_tail - r->cq_head >= RING_ENTRIES)
+      break;
+    __sync_synchronize();
+    // copy the entry so the process cannot change it under us.
+    e = r->sq[r->sq_head % RING_ENTRIES];
+    r->sq_head++;
+    c = &r->cq[r->cq_tail % RING_ENTRIES];
+    c->data = e.data;
+    c->res = ringop(&e);
+    // publish the completion before advancing cq_tail past it.
+    __sync_synchronize();
+    r->cq_tail++;
+  }
+  return done;
+}
@@ -67,21 +67,75 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return ticksleep(n);
+}
+
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return nanosleep(ns);
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setnice(pid, nice);
+}
+
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+uint64
+sys_schedstat(void)
+{
+  int pid;
+  uint64 addr;
+  struct schedstat st;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(getschedstat(pid, &st) < 0)
+    return -1;
+  return copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st));
+}
+
+uint64
+sys_klogread(void)
+{
+  int seq, n;
+  uint64 addr;
+
+  if(argint(0, &seq) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+  return klogread(seq, addr, n);
 }
 
 uint64
@@ -171,18 +225,7 @@ uint64 sys_sem_wait(void) {
     return -1;
   }
 
-  if (semid < 0 || semid >= NSEM || semtable.sem[semid].valid == 0) {
-    return -1;
-  }
-  struct semaphore *s = &semtable.sem[semid];
-  acquire(&s->lock);
-  while (s->count <= 0) {
-    sleep(s, &s->lock); 
-  }
-  
-  s->count--;
-  release(&s->lock);
-  return 0;
+  return semwait(semid);
 }
 
 uint64 sys_sem_post(void) {
@@ -194,16 +237,39 @@ uint64 sys_sem_post(void) {
   if (copyin(myproc()->pagetable, (char *)&semid, sem_addr, sizeof(semid)) < 0) {
     return -1;
   }
-  
-  if (semid < 0 || semid >= NSEM || semtable.sem[semid].valid == 0) {
+
+  return sempost(semid);
+}
+
+// copy the per-syscall statistics selected by which
+// (SYSSTAT_SELF, SYSSTAT_CHILDREN or SYSSTAT_ALL) to
+// a user array of NSYSCALL struct sysstat.
+uint64
+sys_sysstat(void)
+{
+  int which;
+  uint64 addr;
+  struct proc *p = myproc();
+  struct sysstat *all;
+  int r;
+
+  if(argint(0, &which) < 0 || argaddr(1, &addr) < 0)
     return -1;
+
+  switch(which){
+  case SYSSTAT_SELF:
+    return copyout(p->pagetable, addr, (char*)p->stats->sysstat,
+                   sizeof(p->stats->sysstat));
+  case SYSSTAT_CHILDREN:
+    return copyout(p->pagetable, addr, (char*)p->stats->csysstat,
+                   sizeof(p->stats->csysstat));
+  case SYSSTAT_ALL:
+    if((all = kalloc()) == 0)
+      return -1;
+    sysstat_all(all);
+    r = copyout(p->pagetable, addr, (char*)all, NSYSCALL*sizeof(*all));
+    kfree(all);
+    return r;
   }
-  
-  struct semaphore *s = &semtable.sem[semid];
-  acquire(&s->lock);
-  s->count++;
-  wakeup(s);
-  release(&s->lock);
-  
-  return 0; // Success
+  return -1;
 }
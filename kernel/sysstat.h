@@ -0,0 +1,13 @@
+// Per-system-call statistics, as returned by sysstat().
+// Both the kernel and user programs use this header file.
+
+struct sysstat {
+  uint count;     // number of completed calls
+  uint64 max;     // longest call, in mtime cycles
+  uint64 cycles;  // total time spent in calls, in mtime cycles
+};
+
+// which statistics sysstat() returns.
+#define SYSSTAT_SELF      0  // the calling process
+#define SYSSTAT_CHILDREN  1  // children the caller has waited for
+#define SYSSTAT_ALL       2  // every process since boot
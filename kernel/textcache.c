@@ -0,0 +1,193 @@
+//
+// Text page cache.
+//
+// Keeps pages of executables as exec would load them, keyed by
+// (device, inode number, virtual address), so that processes
+// running the same program can map the same physical pages
+// instead of each reading in and holding a copy.  A cached page
+// is mapped read-only, with PTE_S set; vmfault() gives a process
+// that writes to it a private copy.
+//
+// The cache holds one reference to each of its pages (see
+// kalloc.c).  Entries for a file are entered and purged only while
+// its inode is locked: vmfault() enters pages it has just read
+// from the executable, and writei() and itrunc() purge the file's
+// entries before changing it.  iget() purges them when it recycles
+// the in-core inode, since the flag that says the file has
+// entries goes with it.  kalloc() empties the cache when memory
+// runs out.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NTHASH 61
+
+struct textpage {
+  uint dev;
+  uint inum;              // 0 if unused
+  uint64 va;
+  char *pa;
+  struct textpage *hnext; // hash chain
+  struct textpage *prev;  // LRU list
+  struct textpage *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct textpage ent[NTEXTPAGE];
+  struct textpage *hash[NTHASH];
+
+  // all entries, in use or not, most recently used first.
+  struct textpage head;
+} textcache;
+
+void
+textcacheinit(void)
+{
+  struct textpage *t;
+
+  initlock(&textcache.lock, "textcache");
+  textcache.head.prev = &textcache.head;
+  textcache.head.next = &textcache.head;
+  for(t = textcache.ent; t < textcache.ent+NTEXTPAGE; t++){
+    t->inum = 0;  // unused
+    t->next = textcache.head.next;
+    t->prev = &textcache.head;
+    textcache.head.next->prev = t;
+    textcache.head.next = t;
+  }
+}
+
+static uint
+thash(uint dev, uint inum, uint64 va)
+{
+  return ((dev * 31 + inum) * 31 + va / PGSIZE) % NTHASH;
+}
+
+// Find the entry for (dev, inum, va).
+// Caller holds textcache.lock.
+static struct textpage*
+tfind(uint dev, uint inum, uint64 va)
+{
+  struct textpage *t;
+
+  for(t = textcache.hash[thash(dev, inum, va)]; t; t = t->hnext)
+    if(t->inum == inum && t->va == va && t->dev == dev)
+      return t;
+  return 0;
+}
+
+// Take t off its hash chain, drop its page and make it the
+// least recently used.  Caller holds textcache.lock.
+static void
+tremove(struct textpage *t)
+{
+  struct textpage **pp;
+
+  for(pp = &textcache.hash[thash(t->dev, t->inum, t->va)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == t){
+      *pp = t->hnext;
+      break;
+    }
+  }
+  kfree(t->pa);
+  t->inum = 0;
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->next = &textcache.head;
+  t->prev = textcache.head.prev;
+  textcache.head.prev->next = t;
+  textcache.head.prev = t;
+}
+
+// Move t to the front of the LRU list.
+// Caller holds textcache.lock.
+static void
+ttouch(struct textpage *t)
+{
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->next = textcache.head.next;
+  t->prev = &textcache.head;
+  textcache.head.next->prev = t;
+  textcache.head.next = t;
+}
+
+// Return the cached page at va of file inum on dev, with a
+// reference for the caller, or 0 if it is not cached.
+char*
+textcache_lookup(uint dev, uint inum, uint64 va)
+{
+  struct textpage *t;
+  char *pa;
+
+  acquire(&textcache.lock);
+  if((t = tfind(dev, inum, va)) == 0){
+    release(&textcache.lock);
+    return 0;
+  }
+  ttouch(t);
+  pa = t->pa;
+  kdup(pa);
+  release(&textcache.lock);
+  return pa;
+}
+
+// Remember that pa holds the page at va of file inum on dev.
+// The cache takes its own reference to pa.
+// Caller holds the file's inode lock.
+void
+textcache_enter(uint dev, uint inum, uint64 va, char *pa)
+{
+  struct textpage *t;
+  uint h;
+
+  acquire(&textcache.lock);
+  if(tfind(dev, inum, va) == 0){
+    // recycle the least recently used entry.
+    t = textcache.head.prev;
+    if(t->inum != 0)
+      tremove(t);
+    t->dev = dev;
+    t->inum = inum;
+    t->va = va;
+    t->pa = pa;
+    kdup(pa);
+    h = thash(dev, inum, va);
+    t->hnext = textcache.hash[h];
+    textcache.hash[h] = t;
+    ttouch(t);
+  }
+  release(&textcache.lock);
+}
+
+// Forget every page of file inum on dev, which is about to
+// change or leave the inode table.
+void
+textcache_purge(uint dev, uint inum)
+{
+  struct textpage *t;
+
+  acquire(&textcache.lock);
+  for(t = textcache.ent; t < textcache.ent+NTEXTPAGE; t++)
+    if(t->inum == inum && t->dev == dev)
+      tremove(t);
+  release(&textcache.lock);
+}
+
+// Drop every entry, giving back the pages no process maps.
+void
+textcache_shrink(void)
+{
+  struct textpage *t;
+
+  acquire(&textcache.lock);
+  for(t = textcache.ent; t < textcache.ent+NTEXTPAGE; t++)
+    if(t->inum != 0)
+      tremove(t);
+  release(&textcache.lock);
+}
@@ -0,0 +1,196 @@
+//
+// Sleeping timers.
+//
+// A hierarchical timing wheel: NLEVEL levels of NSLOT slots,
+// each slot a list of timers.  A timer due within NSLOT ticks
+// sits in the level 0 slot for its expiry tick; one due later
+// sits in a coarser level, in the slot covering its expiry, and
+// moves down a level ("cascades") when the wheel below comes
+// round to that slot.  So each clock tick touches only the
+// timers due then, and a sleeping process is woken once, when
+// its time is up, instead of on every tick.
+//
+// tickslock protects the wheel, as it does ticks.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define SLOTBITS 6
+#define NSLOT    (1 << SLOTBITS)
+#define NLEVEL   4
+#define SLOTMASK (NSLOT - 1)
+
+struct timer {
+  uint expires;          // tick at which to wake
+  struct timer *next;    // slot list
+  struct timer *prev;
+};
+
+struct {
+  uint now;              // last tick the wheel has processed
+  struct timer slot[NLEVEL][NSLOT];  // list heads
+} wheel;
+
+void
+wheelinit(void)
+{
+  int l, i;
+
+  for(l = 0; l < NLEVEL; l++){
+    for(i = 0; i < NSLOT; i++){
+      wheel.slot[l][i].next = &wheel.slot[l][i];
+      wheel.slot[l][i].prev = &wheel.slot[l][i];
+    }
+  }
+}
+
+// Put t in the slot for its expiry.
+// Caller holds tickslock.
+static void
+timer_add(struct timer *t)
+{
+  struct timer *head;
+  uint delta, when;
+  int l;
+
+  when = t->expires;
+  delta = (int)(when - wheel.now) < 0 ? 0 : when - wheel.now;
+  if(delta >= 1U << (SLOTBITS * NLEVEL)){
+    // too far off: park it in the last slot it can reach,
+    // and put it back when that comes round.
+    delta = (1U << (SLOTBITS * NLEVEL)) - 1;
+    when = wheel.now + delta;
+  }
+  for(l = 0; l < NLEVEL - 1; l++)
+    if(delta < 1U << (SLOTBITS * (l + 1)))
+      break;
+  head = &wheel.slot[l][(when >> (SLOTBITS * l)) & SLOTMASK];
+
+  t->next = head->next;
+  t->prev = head;
+  head->next->prev = t;
+  head->next = t;
+}
+
+// Caller holds tickslock.
+static void
+timer_del(struct timer *t)
+{
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->next = t->prev = t;
+}
+
+// Re-file every timer in slot i of level l in the levels below.
+// Returns i, so that the caller knows whether the level has
+// wrapped round.
+static int
+cascade(int l, int i)
+{
+  struct timer *head, *t;
+
+  head = &wheel.slot[l][i];
+  while((t = head->next) != head){
+    timer_del(t);
+    timer_add(t);
+  }
+  return i;
+}
+
+// Advance the wheel to ticks and wake the processes whose
+// timers have expired.  Called by clockintr() on each tick,
+// with tickslock held.
+void
+timer_tick(void)
+{
+  struct timer *head, *t;
+  int l, i;
+
+  while(wheel.now != ticks){
+    wheel.now++;
+    i = wheel.now & SLOTMASK;
+    for(l = 1; i == 0 && l < NLEVEL; l++)
+      i = cascade(l, (wheel.now >> (SLOTBITS * l)) & SLOTMASK);
+
+    head = &wheel.slot[0][wheel.now & SLOTMASK];
+    while((t = head->next) != head){
+      timer_del(t);
+      if(t->expires != wheel.now)
+        timer_add(t);   // parked; not due yet
+      else
+        wakeup(t);
+    }
+  }
+}
+
+// The next tick at which the wheel has work to do: the first
+// level 0 timer due, or the next cascade, whichever is sooner.
+uint
+timer_next(void)
+{
+  uint t;
+
+  acquire(&tickslock);
+  for(t = wheel.now + 1; (t & SLOTMASK) != 0; t++)
+    if(wheel.slot[0][t & SLOTMASK].next != &wheel.slot[0][t & SLOTMASK])
+      break;
+  release(&tickslock);
+  return t;
+}
+
+// Sleep until ticks reaches until.  Returns 0, or -1 if the
+// process was killed first.  Caller holds tickslock.
+static int
+sleepuntil(uint until)
+{
+  struct timer t;
+
+  t.expires = until;
+  t.next = t.prev = &t;
+  while((int)(until - ticks) > 0){
+    if(myproc()->killed){
+      timer_del(&t);
+      return -1;
+    }
+    if(t.next == &t)
+      timer_add(&t);
+    sleep(&t, &tickslock);
+  }
+  timer_del(&t);
+  return 0;
+}
+
+// Sleep for n clock ticks.
+int
+ticksleep(int n)
+{
+  int r;
+
+  acquire(&tickslock);
+  r = sleepuntil(ticks + n);
+  release(&tickslock);
+  return r;
+}
+
+// Sleep for ns nanoseconds, as measured by the CLINT's mtime.
+// A process only wakes on a clock tick, so the sleep is rounded
+// up to the next tick after the time has passed.
+int
+nanosleep(uint64 ns)
+{
+  uint64 end, now;
+  int r = 0;
+
+  end = r_time() + ns / (1000000000 / MTIME_HZ);
+  acquire(&tickslock);
+  while(r == 0 && (now = r_time()) < end)
+    r = sleepuntil(ticks + 1 + (end - now) / TIMERINTERVAL);
+  release(&tickslock);
+  return r;
+}
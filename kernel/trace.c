@@ -0,0 +1,143 @@
+//
+// Kernel event tracing.
+//
+// trace() appends a record to the calling CPU's ring.  Only that
+// CPU ever writes its ring, and it does so with interrupts off, so
+// recording takes no locks.  Readers of the trace device copy
+// records out from behind the writers and detect records that
+// were overwritten while they were copying.
+//
+// Tracing starts disabled; write "1" to the trace device to turn
+// it on and "0" to turn it off.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+#include "trace.h"
+
+struct tracering {
+  struct tracerec rec[TRACE_RINGSIZE];
+  volatile uint64 head;  // next record to write; only this CPU writes it
+  uint64 tail;           // next record to read; protected by tr.lock
+};
+
+static struct {
+  struct spinlock lock;  // serializes readers
+  volatile int on;
+  uint64 lost;           // records overwritten before being read
+  struct tracering ring[NCPU];
+} tr;
+
+// Append a record to this CPU's ring.
+void
+trace(int type, uint64 a0, uint64 a1)
+{
+  struct tracering *t;
+  struct tracerec *r;
+  struct proc *p;
+
+  if(!tr.on)
+    return;
+
+  push_off();
+  t = &tr.ring[cpuid()];
+  r = &t->rec[t->head & (TRACE_RINGSIZE-1)];
+  p = mycpu()->proc;
+  r->time = r_time();
+  r->type = type;
+  r->cpu = cpuid();
+  r->pid = p ? p->pid : 0;
+  r->a0 = a0;
+  r->a1 = a1;
+  // publish the record before moving head past it.
+  __sync_synchronize();
+  t->head++;
+  pop_off();
+}
+
+// Copy the oldest unread record of any CPU into *r.
+// Returns 0 if every ring is empty.
+static int
+tracepop(struct tracerec *r)
+{
+  struct tracering *t;
+  uint64 head;
+
+  acquire(&tr.lock);
+  for(t = tr.ring; t < &tr.ring[NCPU]; t++){
+    while(t->tail != (head = t->head)){
+      if(head - t->tail > TRACE_RINGSIZE){
+        // the writer lapped us.
+        tr.lost += head - TRACE_RINGSIZE - t->tail;
+        t->tail = head - TRACE_RINGSIZE;
+      }
+      *r = t->rec[t->tail & (TRACE_RINGSIZE-1)];
+      __sync_synchronize();
+      // the slot may have been reused while we copied it.
+      if(t->head - t->tail >= TRACE_RINGSIZE){
+        tr.lost++;
+        t->tail++;
+        continue;
+      }
+      t->tail++;
+      release(&tr.lock);
+      return 1;
+    }
+  }
+  release(&tr.lock);
+  return 0;
+}
+
+//
+// user read()s from the trace device go here.
+// returns as many whole records as fit in n bytes.
+//
+int
+traceread(int user_dst, uint64 dst, int n)
+{
+  struct tracerec r;
+  int tot;
+
+  for(tot = 0; tot + sizeof(r) <= n; tot += sizeof(r)){
+    if(tracepop(&r) == 0)
+      break;
+    if(either_copyout(user_dst, dst + tot, &r, sizeof(r)) == -1)
+      break;
+  }
+  return tot;
+}
+
+//
+// user write()s to the trace device go here.
+// "1" turns tracing on, "0" turns it off.
+//
+int
+tracewrite(int user_src, uint64 src, int n)
+{
+  char c;
+
+  if(n < 1 || either_copyin(&c, user_src, src, 1) == -1)
+    return -1;
+  if(c == '1')
+    tr.on = 1;
+  else if(c == '0')
+    tr.on = 0;
+  else
+    return -1;
+  return n;
+}
+
+void
+traceinit(void)
+{
+  initlock(&tr.lock, "trace");
+  devsw[TRACE].read = traceread;
+  devsw[TRACE].write = tracewrite;
+}
@@ -0,0 +1,29 @@
+// Kernel event tracing.
+// Both the kernel and user programs use this header file.
+//
+// Each CPU appends fixed-size records to its own ring in trace.c;
+// reading the trace device drains the rings.  Records from
+// different CPUs are not merged, so consumers that care about
+// global order should sort by time.
+
+#define TRACE_RINGSIZE 1024  // records per CPU; must be a power of two
+
+// Record types, and what a0/a1 hold for each.
+#define TR_SYSCALL_ENTER  1  // a0 = syscall number
+#define TR_SYSCALL_EXIT   2  // a0 = syscall number, a1 = cycles spent
+#define TR_PAGEFAULT      3  // a0 = faulting va, a1 = scause
+#define TR_SCHED_IN       4  // a0 = pid switched to, a1 = cycles it waited
+#define TR_SCHED_OUT      5  // a0 = pid switched from, a1 = its new state
+#define TR_DISK_SUBMIT    6  // a0 = block number, a1 = 1 if write
+#define TR_DISK_DONE      7  // a0 = block number, a1 = cycles since submit
+#define TR_LOG_COMMIT     8  // a0 = blocks committed, a1 = cycles spent
+#define TR_NTYPES         9
+
+struct tracerec {
+  uint64 time;   // CLINT mtime when the event happened
+  uint16 type;   // TR_xxx
+  uint16 cpu;    // CPU that recorded the event
+  int pid;       // process running on that CPU, or 0
+  uint64 a0;
+  uint64 a1;
+};
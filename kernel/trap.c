@@ -6,10 +6,20 @@
 #include "proc.h"
 #include "defs.h"
 #include "stat.h"
+#include "trace.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "klog.h"
 
 struct spinlock tickslock;
 uint ticks;
 
+// a process that faults over and over, or a device that keeps
+// interrupting, should not fill the kernel log.
+static struct ratelimit faultlimit = { "usertrap" };
+static struct ratelimit irqlimit = { "devintr" };
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -72,107 +82,26 @@ void usertrap(void)
   {
     // ok
   }
-  // -------------------- Lazy Allocation Handler -------------------- begin ----
-  else if (scause == 0xd || scause == 0xf)
+  else if (scause == 0xc || scause == 0xd || scause == 0xf)
   {
-    // load (13) or store (15) page fault
-    uint64 faultva = stval;
-    uint64 roundedFaultyVa = PGROUNDDOWN(faultva);
-    int is_store = (scause == 0xf);
-
-    // Case 1: lazy allocation for heap/stack (HW4)
-    if (faultva < p->sz)
-    {
-      char *mem = kalloc();
-      if (mem == 0)
-      {
-        printf("lazy allocation: kalloc failed for pid=%d\n", p->pid);
-        p->killed = 1;
-      }
-      else
-      {
-        memset(mem, 0, PGSIZE);
-        if (mappages(p->pagetable, roundedFaultyVa, PGSIZE,
-                     (uint64)mem, PTE_R | PTE_W | PTE_X | PTE_U) != 0)
-        {
-          printf("lazy allocation: mappages failed for pid=%d\n", p->pid);
-          kfree(mem);
-          p->killed = 1;
-        }
-      }
-    }
-    else
+    // instruction (12), load (13) or store (15) page fault:
+    // demand paging.  filling the page may sleep on the disk.
+    trace(TR_PAGEFAULT, stval, scause);
+    intr_on();
+    if (vmfault(p->pagetable, stval, scause == 0xf) < 0)
     {
-      // Case 2: maybe this fault is in an mmap()'d region
-      struct mmr *mmr = 0;
-
-      // 2) find mapped memory region that contains faultva
-      for (int i = 0; i < MAX_MMR; i++)
-      {
-        if (p->mmr[i].valid &&
-            faultva >= p->mmr[i].addr &&
-            faultva < p->mmr[i].addr + p->mmr[i].length)
-        {
-          mmr = &p->mmr[i];
-          break;
-        }
-      }
-
-      if (mmr == 0)
-      {
-        // not in any mmapped region: truly invalid
-        printf("usertrap(): invalid access at va=%p (pid=%d, sz=%p)\n",
-               faultva, p->pid, p->sz);
-        p->killed = 1;
-      }
-      else
-      {
-        // 3) check protection
-        if (is_store && !(mmr->prot & PROT_WRITE))
-        {
-          printf("usertrap(): write fault on non-writable VA=%p (pid=%d)\n",
-                 faultva, p->pid);
-          p->killed = 1;
-        }
-        else if (!is_store && !(mmr->prot & PROT_READ))
-        {
-          printf("usertrap(): read fault on non-readable VA=%p (pid=%d)\n",
-                 faultva, p->pid);
-          p->killed = 1;
-        }
-        else
-        {
-          // 4) allocate physical page
-          char *mem = kalloc();
-          if (mem == 0)
-          {
-            printf("mmap lazy allocation: kalloc failed for pid=%d\n", p->pid);
-            p->killed = 1;
-          }
-          else
-          {
-            memset(mem, 0, PGSIZE);
-
-            // 5) roundedFaultyVa is already PGROUNDDOWN(faultva)
-
-            // 6) map the new page into this process page table
-            if (mappages(p->pagetable, roundedFaultyVa, PGSIZE,
-                         (uint64)mem, PTE_R | PTE_W | PTE_U) != 0)
-            {
-              printf("mmap lazy allocation: mappages failed for pid=%d\n", p->pid);
-              kfree(mem);
-              p->killed = 1;
-            }
-          }
-        }
-      }
+      if(ratelimit(&faultlimit))
+        klog("usertrap(): invalid %s at va=%p (pid=%d, sz=%p)",
+             scause == 0xf ? "store" : scause == 0xc ? "fetch" : "load",
+             stval, p->pid, p->sz);
+      p->killed = 1;
     }
   }
-  // -------------------- Lazy Allocation Handler -------------------- end ----
   else
   {
-    printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
-    printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
+    if(ratelimit(&faultlimit))
+      klog("usertrap(): unexpected scause %p pid=%d sepc=%p stval=%p",
+           r_scause(), p->pid, r_sepc(), r_stval());
     p->killed = 1;
   }
 
@@ -186,6 +115,219 @@ void usertrap(void)
   usertrapret();
 }
 
+// Read the part of page va that comes from p's executable
+// into mem, which the caller has zeroed.  Returns -1 if the
+// file could not be read.  Caller holds p->exe's lock.
+static int
+segfill(struct proc *p, uint64 va, char *mem)
+{
+  struct execseg *sg;
+  uint64 start, end;
+
+  for (sg = p->seg; sg < p->seg + p->nseg; sg++)
+  {
+    start = va > sg->va ? va : sg->va;
+    end = va + PGSIZE < sg->va + sg->filesz ? va + PGSIZE : sg->va + sg->filesz;
+    if (start >= end)
+      continue;
+    if (readi(p->exe, 0, (uint64)mem + (start - va),
+              sg->off + (start - sg->va), end - start) != end - start)
+      return -1;
+  }
+  return 0;
+}
+
+// Does any of page va come from p's executable?
+static int
+segpage(struct proc *p, uint64 va)
+{
+  struct execseg *sg;
+
+  for (sg = p->seg; sg < p->seg + p->nseg; sg++)
+    if (va < sg->va + sg->filesz && va + PGSIZE > sg->va)
+      return 1;
+  return 0;
+}
+
+// Map page va of p's executable, sharing the copy in the text
+// cache if there is one and reading the page in and caching it
+// if not.  A store gets a private copy at once.
+static int
+textfault(struct proc *p, uint64 va, int write)
+{
+  struct inode *ip = p->exe;
+  char *pa, *mem;
+  int perm, locked;
+
+  if ((pa = textcache_lookup(ip->dev, ip->inum, va)) == 0)
+  {
+    // reading the page in sleeps, which a copyin() or copyout()
+    // under a spinlock, e.g. in piperead() or wait(), must not;
+    // their callers bring such pages in first with vmprefault().
+    push_off();
+    locked = mycpu()->noff > 1;
+    pop_off();
+    if (locked)
+      return -1;
+    if ((pa = kalloc()) == 0)
+      return -1;
+    memset(pa, 0, PGSIZE);
+    if (holdingsleep(&ip->lock))
+    {
+      // a system call faulted in the middle of reading or
+      // writing the program's own file, e.g. into its bss; the
+      // page is this process's alone.
+      if (segfill(p, va, pa) < 0 ||
+          mappages(p->pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W | PTE_X | PTE_U) != 0)
+      {
+        kfree(pa);
+        return -1;
+      }
+      return 0;
+    }
+    ilock(ip);
+    if (segfill(p, va, pa) < 0)
+    {
+      iunlock(ip);
+      kfree(pa);
+      return -1;
+    }
+    textcache_enter(ip->dev, ip->inum, va, pa);
+    ip->text = 1;
+    iunlock(ip);
+  }
+
+  perm = PTE_R | PTE_X | PTE_U | PTE_S;
+  if (write)
+  {
+    if ((mem = kalloc()) == 0)
+    {
+      kfree(pa);
+      return -1;
+    }
+    memmove(mem, pa, PGSIZE);
+    kfree(pa);
+    pa = mem;
+    perm = PTE_R | PTE_W | PTE_X | PTE_U;
+  }
+  if (mappages(p->pagetable, va, PGSIZE, (uint64)pa, perm) != 0)
+  {
+    kfree(pa);
+    return -1;
+  }
+  return 0;
+}
+
+// Bring in the pages of [va, va+len) that come from the current
+// process's executable and are not mapped yet.  copyin() and
+// copyout() would otherwise read them in with the executable's
+// inode locked while their caller holds another inode's lock,
+// or a buf of the executable itself: two processes reading each
+// other's executables could deadlock, and under a spinlock they
+// cannot read them at all (see textfault()).  fileread(),
+// filewrite() and wait() call this before they lock anything.
+// Returns -1 if a page could not be brought in.
+int
+vmprefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct execseg *sg;
+  uint64 a, end;
+
+  if (p->exe == 0 || va + len < va)
+    return 0;
+  for (sg = p->seg; sg < p->seg + p->nseg; sg++)
+  {
+    a = PGROUNDDOWN(va > sg->va ? va : sg->va);
+    end = va + len < sg->va + sg->filesz ? va + len : sg->va + sg->filesz;
+    for (; a < end; a += PGSIZE)
+      if (walkaddr(p->pagetable, a) == 0 && vmfault(p->pagetable, a, 0) < 0)
+        return -1;
+  }
+  return 0;
+}
+
+// Give the process a private, writable copy of the shared
+// text page that pte maps.
+static int
+textcopy(pte_t *pte)
+{
+  uint64 pa = PTE2PA(*pte);
+  char *mem;
+
+  if ((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char *)pa, PGSIZE);
+  *pte = PA2PTE(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_S);
+  kfree((void *)pa);
+  return 0;
+}
+
+// Bring in the page at va for the current process, whose page
+// table is pagetable, after a fault or for copyin()/copyout():
+// text and data from the executable, zeros for the heap, stack
+// and bss, or a fresh page of an mmap()'d region.  A store to a
+// shared text page copies it.  write says whether the access is
+// a store.  Returns 0 if the access can be retried, -1 if va is
+// not a valid address or memory ran out.
+int
+vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  struct mmr *mmr = 0;
+  pte_t *pte;
+  char *mem;
+  int i, perm;
+
+  if (p == 0 || pagetable != p->pagetable || va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if ((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V))
+  {
+    if (write && (*pte & PTE_S))
+      return textcopy(pte);
+    return -1;  // mapped, but not for this access (e.g. the stack guard)
+  }
+
+  if (va < p->sz)
+  {
+    if (p->exe && segpage(p, va))
+      return textfault(p, va, write);
+    perm = PTE_R | PTE_W | PTE_X | PTE_U;
+  }
+  else
+  {
+    // maybe this fault is in an mmap()'d region
+    for (i = 0; i < MAX_MMR; i++)
+    {
+      if (p->mmr[i].valid &&
+          va >= p->mmr[i].addr &&
+          va < p->mmr[i].addr + p->mmr[i].length)
+      {
+        mmr = &p->mmr[i];
+        break;
+      }
+    }
+    if (mmr == 0)
+      return -1;
+    if (write && !(mmr->prot & PROT_WRITE))
+      return -1;
+    if (!write && !(mmr->prot & PROT_READ))
+      return -1;
+    perm = PTE_R | PTE_W | PTE_U;
+  }
+
+  if ((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if (mappages(pagetable, va, PGSIZE, (uint64)mem, perm) != 0)
+  {
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
 //
 // return to user space
 //
@@ -261,12 +403,61 @@ void kerneltrap()
   w_sstatus(sstatus);
 }
 
+// Set this CPU's timer to interrupt at mtime when.
+static void
+settimer(uint64 when)
+{
+  *(uint64 *)CLINT_MTIMECMP(cpuid()) = when;
+}
+
+// Called on every CPU's timer interrupt.  ticks counts
+// TIMERINTERVALs of mtime, so any CPU that is ticking keeps it
+// current, however long the others have been idle.
 void clockintr()
 {
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
+  struct cpu *c = mycpu();
+  struct proc *p;
+  uint t;
+
+  t = r_time() / TIMERINTERVAL;
+  c->nexttick = (uint64)(t + 1) * TIMERINTERVAL;
+  settimer(c->nexttick);
+
+  if (t != ticks)
+  {
+    acquire(&tickslock);
+    if ((int)(t - ticks) > 0)
+    {
+      ticks = t;
+      timer_tick();
+    }
+    release(&tickslock);
+  }
+
+  // keep the running process's vdso page current.
+  if ((p = myproc()) != 0)
+    vdsoupdate(p);
+}
+
+// Called by the scheduler, with interrupts off, when there is
+// nothing to run.  Stop the ticks, which would only wake the
+// CPU to find nothing to do, except when a sleeping process's
+// timer is due, and wait for an interrupt.
+void cpuidle(void)
+{
+  uint64 when;
+
+  when = (uint64)timer_next() * TIMERINTERVAL;
+  if (when > mycpu()->nexttick)
+    settimer(when);
+  wfi();
+  settimer(mycpu()->nexttick);
+}
+
+// Interrupt CPU id, if it is waiting in cpuidle().
+void ipi(int id)
+{
+  *(uint32 *)CLINT_MSIP(id) = 1;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -296,7 +487,8 @@ int devintr()
     }
     else if (irq)
     {
-      printf("unexpected interrupt irq=%d\n", irq);
+      if(ratelimit(&irqlimit))
+        klog("unexpected interrupt irq=%d", irq);
     }
 
     // the PLIC allows each device to raise at most one
@@ -309,18 +501,26 @@ int devintr()
   }
   else if (scause == 0x8000000000000001L)
   {
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
-
-    if (cpuid() == 0)
-    {
-      clockintr();
-    }
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
 
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    // an IPI only woke the CPU, or asks it to reschedule
+    // for kick() in proc.c.
+    if (r_time() < mycpu()->nexttick)
+    {
+      if (mycpu()->resched)
+      {
+        mycpu()->resched = 0;
+        return 2;
+      }
+      return 1;
+    }
+
+    clockintr();
     return 2;
   }
   else
@@ -38,9 +38,14 @@
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
-// the transmit output buffer.
+#define UART_FIFO 16            // bytes the transmit FIFO holds
+
+// the transmit output buffer.  writers copy whole
+// strings into it, holding uart_tx_lock only while
+// they do; uartstart() hands it to the UART a FIFO
+// at a time, mostly from the transmit interrupt.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 4096
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
@@ -77,15 +82,18 @@ uartinit(void)
   initlock(&uart_tx_lock, "uart");
 }
 
-// add a character to the output buffer and tell the
-// UART to start sending if it isn't already.
-// blocks if the output buffer is full.
-// because it may block, it can't be called
-// from interrupts; it's only suitable for use
-// by write().
+// add n bytes from buf to the output buffer and tell
+// the UART to start sending if it isn't already.
+// if the output buffer is full, a caller that may
+// sleep, like write(), waits for room; other callers,
+// like kernel printf() and echo, which may hold locks
+// or be interrupt handlers, make room by waiting for
+// the UART themselves.
 void
-uartputc(int c)
+uartwrite(char *buf, int n, int cansleep)
 {
+  int m;
+
   acquire(&uart_tx_lock);
 
   if(panicked){
@@ -93,25 +101,58 @@ uartputc(int c)
       ;
   }
 
-  while(1){
+  while(n > 0){
     if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
       // buffer is full.
-      // wait for uartstart() to open up space in the buffer.
-      sleep(&uart_tx_r, &uart_tx_lock);
-    } else {
-      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
-      uart_tx_w += 1;
-      uartstart();
-      release(&uart_tx_lock);
-      return;
+      if(cansleep){
+        // wait for uartstart() to open up space in the buffer.
+        sleep(&uart_tx_r, &uart_tx_lock);
+      } else {
+        while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+          ;
+        uartstart();
+      }
+      continue;
     }
+    // copy as much as fits before the end of the buffer.
+    m = UART_TX_BUF_SIZE - (uart_tx_w - uart_tx_r);
+    if(m > UART_TX_BUF_SIZE - uart_tx_w % UART_TX_BUF_SIZE)
+      m = UART_TX_BUF_SIZE - uart_tx_w % UART_TX_BUF_SIZE;
+    if(m > n)
+      m = n;
+    memmove(&uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE], buf, m);
+    uart_tx_w += m;
+    buf += m;
+    n -= m;
+  }
+  uartstart();
+  release(&uart_tx_lock);
+}
+
+// add n bytes from buf to the output buffer if they
+// fit, without waiting.  returns 0 if they were added,
+// -1 if not.
+int
+uarttrywrite(char *buf, int n)
+{
+  int i;
+
+  acquire(&uart_tx_lock);
+  if(panicked || uart_tx_w + n > uart_tx_r + UART_TX_BUF_SIZE){
+    release(&uart_tx_lock);
+    return -1;
   }
+  for(i = 0; i < n; i++)
+    uart_tx_buf[uart_tx_w++ % UART_TX_BUF_SIZE] = buf[i];
+  uartstart();
+  release(&uart_tx_lock);
+  return 0;
 }
 
-// alternate version of uartputc() that doesn't 
-// use interrupts, for use by kernel printf() and
-// to echo characters. it spins waiting for the uart's
-// output register to be empty.
+// alternate version of uartwrite() that doesn't
+// use interrupts or the output buffer, for use by
+// panic(). it spins waiting for the uart's output
+// register to be empty.
 void
 uartputc_sync(int c)
 {
@@ -130,34 +171,47 @@ uartputc_sync(int c)
   pop_off();
 }
 
-// if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// send whatever is in the output buffer, spinning,
+// without uart_tx_lock, which the caller may have held
+// when it panicked.  for panic().
+void
+uartflush_sync(void)
+{
+  while(uart_tx_r != uart_tx_w){
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r += 1;
+  }
+}
+
+// if the UART's transmit FIFO is empty, and characters
+// are waiting in the transmit buffer, fill it.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
 void
 uartstart()
 {
-  while(1){
-    if(uart_tx_w == uart_tx_r){
-      // transmit buffer is empty.
-      return;
-    }
-    
-    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
-      // the UART transmit holding register is full,
-      // so we cannot give it another byte.
-      // it will interrupt when it's ready for a new byte.
-      return;
-    }
-    
-    int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
+  int i;
+
+  if(uart_tx_w == uart_tx_r){
+    // transmit buffer is empty.
+    return;
+  }
+
+  if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+    // the UART is still sending the last batch.
+    // it will interrupt when the FIFO is empty.
+    return;
+  }
+
+  for(i = 0; i < UART_FIFO && uart_tx_r != uart_tx_w; i++){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
     uart_tx_r += 1;
-    
-    // maybe uartputc() is waiting for space in the buffer.
-    wakeup(&uart_tx_r);
-    
-    WriteReg(THR, c);
   }
+
+  // maybe uartwrite() is waiting for space in the buffer.
+  wakeup(&uart_tx_r);
 }
 
 // read one input character from the UART.
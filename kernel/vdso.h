@@ -0,0 +1,14 @@
+// Kernel data page mapped read-only into every process at VDSO.
+// Both the kernel and user programs use this header file.
+//
+// Each process has its own page.  The kernel refreshes ticks,
+// freepages and cpu when it schedules the process and on every
+// timer interrupt while it runs, so user code can read them
+// without a system call; they may lag the truth by up to a tick.
+
+struct vdso {
+  volatile uint ticks;       // timer ticks since boot, as uptime()
+  volatile int pid;          // this process's pid, as getpid()
+  volatile int cpu;          // CPU the process is running on
+  volatile uint64 freepages; // free physical pages, as freepmem()
+};
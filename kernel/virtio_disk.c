@@ -16,6 +16,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -63,6 +64,8 @@ static struct disk {
   struct {
     struct buf *b;
     char status;
+    char async;    // nobody waits; hand the buf back to bio when done
+    uint64 start;  // time of submission, for tracing
   } info[NUM];
 
   // disk command headers.
@@ -200,13 +203,16 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// queue a read or write of b and tell the device about it,
+// without waiting for it to finish.  if async, nobody will wait:
+// virtio_disk_intr() passes the finished buf to bprefetched(), and
+// if no descriptors are free the request is dropped and -1 returned
+// rather than sleeping.  caller holds disk.vdisk_lock.
+static int
+submit(struct buf *b, int write, int async)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
 
-  acquire(&disk.vdisk_lock);
-
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
   // data, one for a 1-byte status result.
@@ -217,6 +223,8 @@ virtio_disk_rw(struct buf *b, int write)
     if(alloc3_desc(idx) == 0) {
       break;
     }
+    if(async)
+      return -1;
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
@@ -255,6 +263,9 @@ virtio_disk_rw(struct buf *b, int write)
   // record struct buf for virtio_disk_intr().
   b->disk = 1;
   disk.info[idx[0]].b = b;
+  disk.info[idx[0]].async = async;
+  disk.info[idx[0]].start = r_time();
+  trace(TR_DISK_SUBMIT, b->blockno, write);
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -268,14 +279,66 @@ virtio_disk_rw(struct buf *b, int write)
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
+  return 0;
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+  submit(b, write, 0);
+
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  release(&disk.vdisk_lock);
+}
+
+// write n bufs, keeping as many requests in flight as the
+// ring allows, and return once all of them are on disk.
+void
+virtio_disk_writev(struct buf **bs, int n)
+{
+  int i;
 
+  acquire(&disk.vdisk_lock);
+  for(i = 0; i < n; i++)
+    submit(bs[i], 1, 0);
+  for(i = 0; i < n; i++){
+    while(bs[i]->disk == 1) {
+      sleep(bs[i], &disk.vdisk_lock);
+    }
+  }
+  release(&disk.vdisk_lock);
+}
+
+// start reading b from disk and return at once.
+// the caller has marked b busy with b->disk = 1; if the read
+// cannot be queued, clears b->disk and returns -1.
+int
+virtio_disk_read_async(struct buf *b)
+{
+  int r;
+
+  acquire(&disk.vdisk_lock);
+  if((r = submit(b, 0, 1)) < 0){
+    b->disk = 0;
+    wakeup(b);
+  }
+  release(&disk.vdisk_lock);
+  return r;
+}
+
+// wait for any request in flight on b to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  while(b->disk == 1) {
+    sleep(b, &disk.vdisk_lock);
+  }
   release(&disk.vdisk_lock);
 }
 
@@ -305,7 +368,12 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
+    trace(TR_DISK_DONE, b->blockno, r_time() - disk.info[id].start);
+    disk.info[id].b = 0;
+    free_chain(id);
     b->disk = 0;   // disk is done with buf
+    if(disk.info[id].async)
+      bprefetched(b);
     wakeup(b);
 
     disk.used_idx += 1;
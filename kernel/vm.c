@@ -30,6 +30,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, so that the kernel can set timer deadlines and send IPIs
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -320,12 +323,20 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
   char *mem;
 
   for (i = start; i < end; i += PGSIZE) {
-    if ((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if ((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    // pages not yet faulted in stay that way in the child.
+    if ((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if (flags & PTE_S) {
+      // shared text pages stay shared.
+      kdup((void*)pa);
+      if (mappages(new, i, PGSIZE, pa, flags) != 0) {
+        kfree((void*)pa);
+        goto err;
+      }
+      continue;
+    }
     if ((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -383,6 +394,24 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Physical address of the user page at va, faulting it in if it
+// is part of the current process but not there yet, and copying
+// it first if it is a shared text page about to be written.  0
+// if va is not a valid user address.
+static uint64
+uvmpage(pagetable_t pagetable, uint64 va, int write)
+{
+  pte_t *pte;
+  uint64 pa;
+
+  if(write && va < MAXVA && (pte = walk(pagetable, va, 0)) != 0 &&
+     (*pte & PTE_S) && vmfault(pagetable, va, 1) != 0)
+    return 0;
+  if((pa = walkaddr(pagetable, va)) == 0 && vmfault(pagetable, va, write) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -393,7 +422,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmpage(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -418,7 +447,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmpage(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -445,7 +474,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmpage(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
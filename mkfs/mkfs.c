@@ -4,7 +4,10 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <dirent.h>
 
+typedef struct dirent hostdirent;
+#define dirent xv6_dirent  // avoid clash with host struct dirent
 #define stat xv6_stat  // avoid clash with host struct stat
 #include "kernel/types.h"
 #include "kernel/fs.h"
@@ -20,15 +23,17 @@
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int fssize = FSSIZE;
+int ninodes = NINODES;
+int nlog = LOGBLOCKS;
+int nbitmap;
+int ninodeblocks;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
 int fsfd;
+char *img;    // the image, built in memory
 struct superblock sb;
-char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
 
@@ -40,6 +45,9 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void addfile(uint dir, char *path, char *name);
+void adddir(uint dir, char *path);
+void flush(void);
 void die(const char *);
 
 // convert to intel byte order
@@ -68,17 +76,43 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
-  uint rootino, inum, off;
+  int i;
+  uint rootino, off;
+  char *tree = 0;
   struct dirent de;
   char buf[BSIZE];
   struct dinode din;
+  struct logsuper ls;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  while((i = getopt(argc, argv, "s:l:i:d:")) != -1){
+    switch(i){
+    case 's':
+      fssize = atoi(optarg);
+      break;
+    case 'l':
+      nlog = atoi(optarg);
+      break;
+    case 'i':
+      ninodes = atoi(optarg);
+      break;
+    case 'd':
+      tree = optarg;
+      break;
+    default:
+      goto usage;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  // a directory entry holds an inode number in a ushort.
+  if(argc < 2 || nlog < MAXOPBLOCKS + 2 || ninodes < 2 || ninodes > 65535 ||
+     fssize <= 0 || fssize > MAXBMAP*BPB){
+  usage:
+    fprintf(stderr, "Usage: mkfs [-s blocks] [-l logblocks] [-i inodes] "
+            "[-d dir] fs.img files...\n");
     exit(1);
   }
 
@@ -89,31 +123,46 @@ main(int argc, char *argv[])
   if(fsfd < 0)
     die(argv[1]);
 
+  // build the whole image in memory, then write it out at once.
+  if((img = calloc(fssize, BSIZE)) == 0)
+    die("calloc");
+
   // 1 fs block = 1 disk sector
+  nbitmap = fssize/(BSIZE*8) + 1;
+  ninodeblocks = ninodes / IPB + 1;
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  nblocks = fssize - nmeta;
+  if(nblocks <= 0){
+    fprintf(stderr, "mkfs: %d blocks leave no room for data\n", fssize);
+    exit(1);
+  }
 
   sb.magic = FSMAGIC;
-  sb.size = xint(FSSIZE);
+  sb.size = xint(fssize);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ninodes);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
-    wsect(i, zeroes);
-
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
   wsect(1, buf);
 
+  // an empty log.
+  ls.magic = xint(LOGMAGIC);
+  ls.seq = xint(1);
+  ls.tail = xint(0);
+  memset(buf, 0, sizeof(buf));
+  memmove(buf, &ls, sizeof(ls));
+  wsect(2, buf);
+
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
@@ -137,9 +186,6 @@ main(int argc, char *argv[])
     
     assert(index(shortname, '/') == 0);
 
-    if((fd = open(argv[i], 0)) < 0)
-      die(argv[i]);
-
     // Skip leading _ in name when writing to file system.
     // The binaries are named _rm, _cat, etc. to keep the
     // build operating system from trying to execute them
@@ -147,19 +193,12 @@ main(int argc, char *argv[])
     if(shortname[0] == '_')
       shortname += 1;
 
-    inum = ialloc(T_FILE);
-
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
-
-    while((cc = read(fd, buf, sizeof(buf))) > 0)
-      iappend(inum, buf, cc);
-
-    close(fd);
+    addfile(rootino, argv[i], shortname);
   }
 
+  if(tree)
+    adddir(rootino, tree);
+
   // fix size of root inode dir
   rinode(rootino, &din);
   off = xint(din.size);
@@ -169,16 +208,117 @@ main(int argc, char *argv[])
 
   balloc(freeblock);
 
+  flush();
+  close(fsfd);
   exit(0);
 }
 
+// Enter name for inum in directory dir.
+void
+dirlink(uint dir, char *name, uint inum)
+{
+  struct dirent de;
+
+  bzero(&de, sizeof(de));
+  de.inum = xshort(inum);
+  strncpy(de.name, name, DIRSIZ);
+  iappend(dir, &de, sizeof(de));
+}
+
+// Copy the host file path into directory dir as name.
+void
+addfile(uint dir, char *path, char *name)
+{
+  static char buf[64*1024];
+  int fd, cc;
+  uint inum;
+
+  if((fd = open(path, 0)) < 0)
+    die(path);
+
+  inum = ialloc(T_FILE);
+  dirlink(dir, name, inum);
+
+  while((cc = read(fd, buf, sizeof(buf))) > 0)
+    iappend(inum, buf, cc);
+  if(cc < 0)
+    die(path);
+
+  close(fd);
+}
+
+// Copy the contents of the host directory path, recursively,
+// into directory dir.
+void
+adddir(uint dir, char *path)
+{
+  DIR *d, *sub;
+  hostdirent *e;
+  struct dinode din;
+  char *child;
+  uint inum;
+
+  if((d = opendir(path)) == 0)
+    die(path);
+  while((e = readdir(d)) != 0){
+    if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+      continue;
+    if(strlen(e->d_name) > DIRSIZ){
+      fprintf(stderr, "mkfs: skipping %s/%s: name too long\n", path, e->d_name);
+      continue;
+    }
+    if((child = malloc(strlen(path) + strlen(e->d_name) + 2)) == 0)
+      die("malloc");
+    sprintf(child, "%s/%s", path, e->d_name);
+    if((sub = opendir(child)) != 0){
+      closedir(sub);
+      inum = ialloc(T_DIR);
+      dirlink(inum, ".", inum);
+      dirlink(inum, "..", dir);
+      dirlink(dir, e->d_name, inum);
+      // for "..", as mkdir does.
+      rinode(dir, &din);
+      din.nlink = xshort(xshort(din.nlink) + 1);
+      winode(dir, &din);
+      adddir(inum, child);
+    } else {
+      addfile(dir, child, e->d_name);
+    }
+    free(child);
+  }
+  closedir(d);
+}
+
+// Write the image to fsfd in large sequential chunks.
+void
+flush(void)
+{
+  size_t n, done, total;
+  ssize_t cc;
+
+  total = (size_t)fssize * BSIZE;
+  for(done = 0; done < total; done += cc){
+    n = total - done < 1024*1024 ? total - done : 1024*1024;
+    if((cc = write(fsfd, img + done, n)) <= 0)
+      die("write");
+  }
+}
+
+// The image's block sec.
+char*
+block(uint sec)
+{
+  if(sec >= fssize){
+    fprintf(stderr, "mkfs: file system full\n");
+    exit(1);
+  }
+  return img + (size_t)sec * BSIZE;
+}
+
 void
 wsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
-    die("lseek");
-  if(write(fsfd, buf, BSIZE) != BSIZE)
-    die("write");
+  memmove(block(sec), buf, BSIZE);
 }
 
 void
@@ -211,10 +351,7 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
-    die("lseek");
-  if(read(fsfd, buf, BSIZE) != BSIZE)
-    die("read");
+  memmove(buf, block(sec), BSIZE);
 }
 
 uint
@@ -223,6 +360,10 @@ ialloc(ushort type)
   uint inum = freeinode++;
   struct dinode din;
 
+  if(inum >= ninodes){
+    fprintf(stderr, "mkfs: out of inodes\n");
+    exit(1);
+  }
   bzero(&din, sizeof(din));
   din.type = xshort(type);
   din.nlink = xshort(1);
@@ -235,16 +376,17 @@ void
 balloc(int used)
 {
   uchar buf[BSIZE];
-  int i;
+  int i, b;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  for(b = 0; b * BPB < used; b++){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BPB && b * BPB + i < used; i++){
+      buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    printf("balloc: write bitmap block at sector %d\n", sb.bmapstart + b);
+    wsect(sb.bmapstart + b, buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
@@ -255,9 +397,8 @@ iappend(uint inum, void *xp, int n)
   char *p = (char*)xp;
   uint fbn, off, n1;
   struct dinode din;
-  char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint x, ind;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -270,7 +411,7 @@ iappend(uint inum, void *xp, int n)
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
         din.addrs[NDIRECT] = xint(freeblock++);
       }
@@ -280,11 +421,28 @@ iappend(uint inum, void *xp, int n)
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      // doubly-indirect: find the indirect block, then the data block.
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      x = (fbn - NDIRECT - NINDIRECT) / NINDIRECT;
+      if(indirect[x] == 0){
+        indirect[x] = xint(freeblock++);
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      ind = xint(indirect[x]);
+      rsect(ind, (char*)indirect);
+      x = (fbn - NDIRECT - NINDIRECT) % NINDIRECT;
+      if(indirect[x] == 0){
+        indirect[x] = xint(freeblock++);
+        wsect(ind, (char*)indirect);
+      }
+      x = xint(indirect[x]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
-    rsect(x, buf);
-    bcopy(p, buf + off - (fbn * BSIZE), n1);
-    wsect(x, buf);
+    bcopy(p, block(x) + off - (fbn * BSIZE), n1);
     n -= n1;
     off += n1;
     p += n1;
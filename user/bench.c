@@ -0,0 +1,383 @@
+// bench: microbenchmarks for tracking performance regressions.
+//
+//   bench [-r reps] [name ...]   run the named benchmarks, or all
+//
+// Each benchmark is a function that performs a fixed number of
+// operations.  It is run a few times to warm up, then timed over
+// reps repetitions with the time CSR and the tick counter, and the
+// distribution of cycles per operation is reported as one line,
+// with the number of system calls the timed repetitions made:
+//
+//   bench <name> ops <n> reps <n> min <c> p50 <c> p90 <c> p99 <c> max <c> ticks <t> syscalls <s>
+//
+// "make bench" boots xv6 for several CPU counts, runs this and
+// collects those lines.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+#define WARMUP   3    // untimed repetitions before measuring
+#define MAXREPS  100
+
+//
+// timing framework
+//
+
+struct bench {
+  char *name;
+  int ops;                 // operations per repetition
+  void (*setup)(void);     // before warmup; may be 0
+  void (*run)(int ops);    // one repetition
+  void (*cleanup)(void);   // after the last repetition; may be 0
+};
+
+uint64 samples[MAXREPS];
+struct sysstat st[NSYSCALL];
+
+// Read the time CSR; the kernel lets user mode do so.
+static inline uint64
+rdtime(void)
+{
+  uint64 t;
+  asm volatile("rdtime %0" : "=r" (t));
+  return t;
+}
+
+void
+sort(uint64 *v, int n)
+{
+  int i, j;
+  uint64 x;
+
+  for(i = 1; i < n; i++){
+    x = v[i];
+    for(j = i; j > 0 && v[j-1] > x; j--)
+      v[j] = v[j-1];
+    v[j] = x;
+  }
+}
+
+// The pct'th percentile of the n sorted values in v.
+uint64
+percentile(uint64 *v, int n, int pct)
+{
+  return v[(n - 1) * pct / 100];
+}
+
+// System calls this process has made.
+uint
+syscalls(void)
+{
+  int i;
+  uint n;
+
+  if(sysstat(SYSSTAT_SELF, st) < 0)
+    return 0;
+  n = 0;
+  for(i = 0; i < NSYSCALL; i++)
+    n += st[i].count;
+  return n;
+}
+
+void
+measure(struct bench *b, int reps)
+{
+  int i, t0, ticks;
+  uint64 c0;
+  uint s0, calls;
+
+  if(b->setup)
+    b->setup();
+  for(i = 0; i < WARMUP; i++)
+    b->run(b->ops);
+  t0 = vdso_uptime();
+  s0 = syscalls();
+  for(i = 0; i < reps; i++){
+    c0 = rdtime();
+    b->run(b->ops);
+    samples[i] = (rdtime() - c0) / b->ops;
+  }
+  // don't count the second syscalls() itself.
+  calls = syscalls() - s0 - 1;
+  ticks = vdso_uptime() - t0;
+  if(b->cleanup)
+    b->cleanup();
+
+  sort(samples, reps);
+  printf("bench %s ops %d reps %d min %d p50 %d p90 %d p99 %d max %d ticks %d syscalls %d\n",
+         b->name, b->ops, reps,
+         (int)samples[0],
+         (int)percentile(samples, reps, 50),
+         (int)percentile(samples, reps, 90),
+         (int)percentile(samples, reps, 99),
+         (int)samples[reps-1], ticks, calls);
+}
+
+void
+fail(char *what)
+{
+  fprintf(2, "bench: %s failed\n", what);
+  exit(1);
+}
+
+//
+// benchmarks
+//
+
+// fork a child that exits at once, and wait for it.
+void
+forkexit(int ops)
+{
+  int i, pid;
+
+  for(i = 0; i < ops; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+}
+
+// fork a child that execs this program with nothing to do.
+void
+forkexec(int ops)
+{
+  int i, pid;
+  char *argv[] = { "bench", "-n", 0 };
+
+  for(i = 0; i < ops; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0){
+      exec("bench", argv);
+      fail("exec");
+    }
+    wait(0);
+  }
+}
+
+// grow the heap and take one lazy-allocation fault per page.
+void
+pagefault(int ops)
+{
+  char *p;
+  int i;
+
+  if((p = sbrk(ops * 4096)) == (char*)-1)
+    fail("sbrk");
+  for(i = 0; i < ops; i++)
+    p[i * 4096] = 1;
+  sbrk(-ops * 4096);
+}
+
+// map, touch and unmap a private anonymous page.
+void
+mapunmap(int ops)
+{
+  char *p;
+  int i;
+
+  for(i = 0; i < ops; i++){
+    p = mmap(0, 4096, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(p == (char*)-1)
+      fail("mmap");
+    p[0] = 1;
+    if(munmap(p, 4096) < 0)
+      fail("munmap");
+  }
+}
+
+// push 512-byte writes through a pipe to a child that drains it.
+int pipefd = -1;
+int pipepid;
+char pipebuf[512];
+
+void
+pipesetup(void)
+{
+  int fds[2];
+
+  if(pipe(fds) < 0)
+    fail("pipe");
+  if((pipepid = fork()) < 0)
+    fail("fork");
+  if(pipepid == 0){
+    close(fds[1]);
+    while(read(fds[0], pipebuf, sizeof(pipebuf)) > 0)
+      ;
+    exit(0);
+  }
+  close(fds[0]);
+  pipefd = fds[1];
+}
+
+void
+pipewrite(int ops)
+{
+  int i;
+
+  for(i = 0; i < ops; i++)
+    if(write(pipefd, pipebuf, sizeof(pipebuf)) != sizeof(pipebuf))
+      fail("pipe write");
+}
+
+void
+pipecleanup(void)
+{
+  close(pipefd);
+  wait(0);
+}
+
+// bounce between two processes with a pair of semaphores.
+struct pingpong {
+  sem_t ping;
+  sem_t pong;
+  int stop;
+} *pp;
+
+void
+semsetup(void)
+{
+  int pid;
+
+  pp = mmap(0, sizeof(*pp), PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if(pp == (struct pingpong*)-1)
+    fail("mmap");
+  pp->stop = 0;
+  if(sem_init(&pp->ping, 1, 0) < 0 || sem_init(&pp->pong, 1, 0) < 0)
+    fail("sem_init");
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    for(;;){
+      sem_wait(&pp->ping);
+      if(pp->stop)
+        exit(0);
+      sem_post(&pp->pong);
+    }
+  }
+}
+
+void
+semrun(int ops)
+{
+  int i;
+
+  for(i = 0; i < ops; i++){
+    sem_post(&pp->ping);
+    sem_wait(&pp->pong);
+  }
+}
+
+void
+semcleanup(void)
+{
+  pp->stop = 1;
+  sem_post(&pp->ping);
+  wait(0);
+  sem_destroy(&pp->ping);
+  sem_destroy(&pp->pong);
+  munmap(pp, sizeof(*pp));
+}
+
+// create, write, read back and unlink a 1KB file.
+char filebuf[1024];
+
+void
+fileops(int ops)
+{
+  int i, fd;
+
+  for(i = 0; i < ops; i++){
+    if((fd = open("bench.tmp", O_CREATE | O_WRONLY)) < 0)
+      fail("create");
+    if(write(fd, filebuf, sizeof(filebuf)) != sizeof(filebuf))
+      fail("write");
+    close(fd);
+    if((fd = open("bench.tmp", O_RDONLY)) < 0)
+      fail("open");
+    if(read(fd, filebuf, sizeof(filebuf)) != sizeof(filebuf))
+      fail("read");
+    close(fd);
+    if(unlink("bench.tmp") < 0)
+      fail("unlink");
+  }
+}
+
+// print short lines to a file through the buffered printf.
+int printffd = -1;
+
+void
+printfsetup(void)
+{
+  if((printffd = open("bench.tmp", O_CREATE | O_TRUNC | O_WRONLY)) < 0)
+    fail("create");
+}
+
+void
+printfrun(int ops)
+{
+  int i;
+
+  for(i = 0; i < ops; i++)
+    fprintf(printffd, "line %d\n", i);
+  fflush(printffd);
+}
+
+void
+printfcleanup(void)
+{
+  close(printffd);
+  unlink("bench.tmp");
+}
+
+struct bench benches[] = {
+  { "forkexit",  16, 0,         forkexit,  0 },
+  { "forkexec",  4,  0,         forkexec,  0 },
+  { "pagefault", 64, 0,         pagefault, 0 },
+  { "mmap",      32, 0,         mapunmap,  0 },
+  { "pipe",      64, pipesetup, pipewrite, pipecleanup },
+  { "sem",       64, semsetup,  semrun,    semcleanup },
+  { "file",      8,  0,         fileops,   0 },
+  { "printf",    64, printfsetup, printfrun, printfcleanup },
+};
+#define NBENCH (sizeof(benches) / sizeof(benches[0]))
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, k, reps, want;
+
+  // forkexec's child: do nothing.
+  if(argc == 2 && strcmp(argv[1], "-n") == 0)
+    exit(0);
+
+  reps = 20;
+  i = 1;
+  if(argc > 2 && strcmp(argv[1], "-r") == 0){
+    reps = atoi(argv[2]);
+    i = 3;
+  }
+  if(reps < 1 || reps > MAXREPS){
+    fprintf(2, "usage: bench [-r reps] [name ...]\n");
+    exit(1);
+  }
+
+  for(j = 0; j < NBENCH; j++){
+    want = i == argc;
+    for(k = i; k < argc; k++)
+      if(strcmp(argv[k], benches[j].name) == 0)
+        want = 1;
+    if(want)
+      measure(&benches[j], reps);
+  }
+  printf("bench done\n");
+  exit(0);
+}
@@ -0,0 +1,65 @@
+// dmesg: print the kernel log.
+//
+//   dmesg [-f]   with -f, keep printing messages as they are logged
+//
+// Each message is printed with the time it was logged, in
+// seconds since boot, and the CPU that logged it.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/klog.h"
+#include "user/user.h"
+
+#define NREC 16
+
+struct klogrec rec[NREC];
+
+void
+print(struct klogrec *r)
+{
+  char text[KLOGTEXT + 1];
+  int ms;
+
+  memmove(text, r->text, r->len);
+  text[r->len] = 0;
+  ms = (int)((uint64)r->ticks * TIMERINTERVAL / (MTIME_HZ / 1000));
+  printf("[%d.%d%d%d] cpu%d: %s\n", ms / 1000, ms / 100 % 10, ms / 10 % 10,
+         ms % 10, r->cpu, text);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, follow;
+  uint next;
+
+  follow = 0;
+  if(argc == 2 && strcmp(argv[1], "-f") == 0)
+    follow = 1;
+  else if(argc != 1){
+    fprintf(2, "usage: dmesg [-f]\n");
+    exit(1);
+  }
+
+  next = 0;  // the oldest message the kernel has
+  for(;;){
+    if((n = klogread(next, rec, NREC)) < 0){
+      fprintf(2, "dmesg: klogread failed\n");
+      exit(1);
+    }
+    for(i = 0; i < n; i++){
+      // the kernel overwrote some before we could read them.
+      if(next != 0 && rec[i].seq != next)
+        printf("dmesg: %d messages lost\n", rec[i].seq - next);
+      print(&rec[i]);
+      next = rec[i].seq + 1;
+    }
+    if(n == NREC)
+      continue;
+    if(!follow)
+      break;
+    sleep(1);
+  }
+  exit(0);
+}
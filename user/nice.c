@@ -0,0 +1,80 @@
+// nice: run a command with a different nice value, or show
+// processes' scheduling statistics.
+//
+//   nice [-n adjustment] command [arg ...]   default adjustment 10
+//   nice -p pid ...
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/memlayout.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+#define MS(cycles) ((int)((cycles) / (MTIME_HZ / 1000)))
+
+// atoi() with an optional sign.
+int
+satoi(char *s)
+{
+  if(*s == '-')
+    return -atoi(s + 1);
+  if(*s == '+')
+    s++;
+  return atoi(s);
+}
+
+void
+usage(void)
+{
+  fprintf(2, "usage: nice [-n adjustment] command [arg ...]\n"
+             "       nice -p pid ...\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat st;
+  int i, adj, nice;
+
+  if(argc < 2)
+    usage();
+
+  if(strcmp(argv[1], "-p") == 0){
+    if(argc < 3)
+      usage();
+    for(i = 2; i < argc; i++){
+      if(schedstat(atoi(argv[i]), &st) < 0){
+        fprintf(2, "nice: no process %s\n", argv[i]);
+        continue;
+      }
+      printf("%s: nice %d runs %d cpu %dms wait %dms maxwait %dms\n",
+             argv[i], st.nice, st.nrun, MS(st.runtime),
+             MS(st.waittime), MS(st.maxwait));
+    }
+    exit(0);
+  }
+
+  adj = 10;
+  i = 1;
+  if(strcmp(argv[1], "-n") == 0){
+    if(argc < 4)
+      usage();
+    adj = satoi(argv[2]);
+    i = 3;
+  }
+  if(schedstat(0, &st) < 0)
+    exit(1);
+  nice = st.nice + adj;
+  if(nice < NICE_MIN)
+    nice = NICE_MIN;
+  if(nice > NICE_MAX)
+    nice = NICE_MAX;
+  if(setpriority(0, nice) < 0){
+    fprintf(2, "nice: setpriority failed\n");
+    exit(1);
+  }
+  exec(argv[i], argv + i);
+  fprintf(2, "nice: exec %s failed\n", argv[i]);
+  exit(1);
+}
@@ -4,20 +4,160 @@
 
 #include <stdarg.h>
 
+// Buffered I/O.
+//
+// Output to each of the first NSTDIO file descriptors collects
+// in a buffer, which is written when it fills, when a line ends
+// if fd is a console (line buffering), and before the program
+// exits, forks, execs or closes fd; see stdiosync in ulib.c.
+// Other descriptors get one write per printf.
+// Reads through fgets() and gets() fill a buffer too, and so
+// may take more input from fd than they return.
+
+#define NSTDIO 8
+#define BUFSZ  512
+
+#define UNKNOWN 0  // not yet used since open
+#define LINEBUF 1
+#define FULLBUF 2
+
+struct stdbuf {
+  int mode;        // for output: UNKNOWN, LINEBUF or FULLBUF
+  int n;           // bytes buffered
+  int pos;         // for input: next byte to return
+  char buf[BUFSZ];
+};
+
+static struct stdbuf out[NSTDIO];
+static struct stdbuf in[NSTDIO];
+static struct stdbuf other;  // one printf's output to fd >= NSTDIO
+
 static char digits[] = "0123456789ABCDEF";
 
+static void
+sync(int fd, int closing)
+{
+  int i;
+
+  if(fd < 0){
+    for(i = 0; i < NSTDIO; i++)
+      fflush(i);
+    return;
+  }
+  fflush(fd);
+  if(closing && fd < NSTDIO){
+    out[fd].mode = UNKNOWN;
+    in[fd].n = in[fd].pos = 0;
+  }
+}
+
+static struct stdbuf*
+outbuf(int fd)
+{
+  struct stat st;
+  struct stdbuf *b;
+
+  if(fd < 0 || fd >= NSTDIO)
+    return &other;
+  b = &out[fd];
+  if(b->mode == UNKNOWN){
+    stdiosync = sync;
+    if(fstat(fd, &st) >= 0 && st.type == T_DEVICE)
+      b->mode = LINEBUF;
+    else
+      b->mode = FULLBUF;
+  }
+  return b;
+}
+
+static void
+flushbuf(int fd, struct stdbuf *b)
+{
+  if(b->n > 0)
+    write(fd, b->buf, b->n);
+  b->n = 0;
+}
+
+// Write fd's buffered output.
+void
+fflush(int fd)
+{
+  if(fd >= 0 && fd < NSTDIO)
+    flushbuf(fd, &out[fd]);
+}
+
 static void
 putc(int fd, char c)
 {
-  write(fd, &c, 1);
+  struct stdbuf *b;
+
+  b = outbuf(fd);
+  if(b->n == BUFSZ)
+    flushbuf(fd, b);
+  b->buf[b->n++] = c;
+  if(c == '\n' && b->mode == LINEBUF)
+    flushbuf(fd, b);
+}
+
+// Buffered write: like write(), but collects small writes.
+int
+fwrite(int fd, const void *p, int n)
+{
+  struct stdbuf *b;
+  const char *s;
+  int i;
+
+  b = outbuf(fd);
+  if(b == &other || n >= BUFSZ){
+    flushbuf(fd, b);
+    return write(fd, p, n);
+  }
+  s = p;
+  for(i = 0; i < n; i++)
+    putc(fd, s[i]);
+  return n;
+}
+
+// Read a line, up to max-1 bytes, from fd into buf.
+// Returns buf, holding "" at end of file.
+char*
+fgets(int fd, char *buf, int max)
+{
+  struct stdbuf *b;
+  int i, cc;
+  char c;
+
+  stdiosync = sync;
+  for(i=0; i+1 < max; ){
+    if(fd < 0 || fd >= NSTDIO){
+      if(read(fd, &c, 1) < 1)
+        break;
+    } else {
+      b = &in[fd];
+      if(b->pos == b->n){
+        // show any prompt before waiting for input.
+        sync(-1, 0);
+        b->pos = b->n = 0;
+        if((cc = read(fd, b->buf, BUFSZ)) < 1)
+          break;
+        b->n = cc;
+      }
+      c = b->buf[b->pos++];
+    }
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return buf;
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(int fd, long long xx, int base, int sgn)
 {
-  char buf[16];
+  char buf[24];
   int i, neg;
-  uint x;
+  uint64 x;
 
   neg = 0;
   if(sgn && xx < 0){
@@ -47,13 +187,17 @@ printptr(int fd, uint64 x) {
     putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
+// Print to the given fd. Only understands %d, %l (a uint64), %x,
+// %p, %c, %s.
 void
 vprintf(int fd, const char *fmt, va_list ap)
 {
   char *s;
   int c, i, state;
 
+  if(fd < 0 || fd >= NSTDIO)
+    other.n = 0;
+
   state = 0;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
@@ -69,7 +213,7 @@ vprintf(int fd, const char *fmt, va_list ap)
       } else if(c == 'l') {
         printint(fd, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(fd, va_arg(ap, uint), 16, 0);
       } else if(c == 'p') {
         printptr(fd, va_arg(ap, uint64));
       } else if(c == 's'){
@@ -92,6 +236,8 @@ vprintf(int fd, const char *fmt, va_list ap)
       state = 0;
     }
   }
+  if(fd < 0 || fd >= NSTDIO)
+    flushbuf(fd, &other);
 }
 
 void
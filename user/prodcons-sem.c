@@ -78,14 +78,22 @@ void consumer()
   }
 }
 
+// With -p, pin producers to CPU 0 and consumers to CPU 1.
+void pin(int pinned, int cpu)
+{
+  if (pinned && sched_setaffinity(0, 1 << cpu) < 0)
+    printf("%d: cannot pin to CPU %d\n", getpid(), cpu);
+}
+
 int main(int argc, char *argv[])
 {
-  if (argc != 3) {
-     printf("usage: %s <nproducers> <nconsumers>\n", argv[0]);
+  if (argc != 3 && !(argc == 4 && strcmp(argv[3], "-p") == 0)) {
+     printf("usage: %s <nproducers> <nconsumers> [-p]\n", argv[0]);
      exit(0);
   }
   int nproducers = atoi(argv[1]);
   int nconsumers = atoi(argv[2]);
+  int pinned = argc == 4;
   int i;
 
   buffer = (buffer_t *) mmap(NULL, sizeof(buffer_t), 
@@ -105,11 +113,13 @@ int main(int argc, char *argv[])
 
   for (i = 0; i < nconsumers; i++)
     if (!fork()) { 
+      pin(pinned, 1);
       consumer();
       exit(0);
     }
   for (i = 0; i < nproducers; i++)
     if (!fork()) {
+      pin(pinned, 0);
       producer();
       exit(0);
     }
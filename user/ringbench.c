@@ -0,0 +1,158 @@
+// ringbench: compare small reads and writes issued one system
+// call at a time with the same operations batched through the
+// submission ring.
+//
+//   ringbench [chunk]   chunk is the bytes per operation (default 64)
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/sysstat.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+#define FILESIZE (32*1024)
+#define ROUNDS   4
+#define BATCH    32
+
+char data[FILESIZE];
+char check[FILESIZE];
+struct sysstat st[NSYSCALL];
+struct ring *r;
+
+uint
+syscalls(void)
+{
+  int i;
+  uint n;
+
+  if(sysstat(SYSSTAT_SELF, st) < 0){
+    fprintf(2, "ringbench: sysstat failed\n");
+    exit(1);
+  }
+  n = 0;
+  for(i = 0; i < NSYSCALL; i++)
+    n += st[i].count;
+  return n;
+}
+
+// Queue one operation; the submission queue must have room.
+void
+submit(int op, int fd, char *addr, int n)
+{
+  struct ring_sqe *e;
+
+  e = &r->sq[r->sq_tail % RING_ENTRIES];
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->n = n;
+  e->data = n;  // the result we expect back
+  // the entry must be complete before the kernel can see it.
+  __sync_synchronize();
+  r->sq_tail++;
+}
+
+// Hand every queued operation to the kernel and reap the
+// completions, each of which should have moved all its bytes.
+void
+flush(void)
+{
+  struct ring_cqe *c;
+  int n;
+
+  n = r->sq_tail - r->sq_head;
+  if(n == 0)
+    return;
+  if(ring_enter(n) != n){
+    fprintf(2, "ringbench: ring_enter failed\n");
+    exit(1);
+  }
+  while(r->cq_head != r->cq_tail){
+    c = &r->cq[r->cq_head % RING_ENTRIES];
+    if(c->res != c->data){
+      fprintf(2, "ringbench: operation returned %d, not %d\n",
+              c->res, (int)c->data);
+      exit(1);
+    }
+    r->cq_head++;
+  }
+}
+
+void
+pass(int viaring, int writing, int chunk)
+{
+  int fd, off, n;
+  char *buf;
+
+  fd = open("ringbench.tmp", writing ? O_CREATE|O_TRUNC|O_WRONLY : O_RDONLY);
+  if(fd < 0){
+    fprintf(2, "ringbench: cannot open ringbench.tmp\n");
+    exit(1);
+  }
+  buf = writing ? data : check;
+  for(off = 0; off < FILESIZE; off += chunk){
+    n = chunk < FILESIZE - off ? chunk : FILESIZE - off;
+    if(viaring){
+      submit(writing ? RING_WRITE : RING_READ, fd, buf + off, n);
+      if(r->sq_tail - r->sq_head == BATCH)
+        flush();
+    } else if((writing ? write(fd, buf + off, n) : read(fd, buf + off, n)) != n){
+      fprintf(2, "ringbench: %s failed\n", writing ? "write" : "read");
+      exit(1);
+    }
+  }
+  if(viaring)
+    flush();
+  close(fd);
+}
+
+void
+run(char *name, int viaring, int writing, int chunk)
+{
+  int i, t0;
+  uint c0, calls;
+
+  t0 = uptime();
+  c0 = syscalls();
+  for(i = 0; i < ROUNDS; i++){
+    if(!writing)
+      memset(check, 0, sizeof(check));
+    pass(viaring, writing, chunk);
+    if(!writing && memcmp(data, check, FILESIZE) != 0){
+      fprintf(2, "ringbench: %s read back wrong data\n", name);
+      exit(1);
+    }
+  }
+  // don't count the two syscalls() calls themselves.
+  calls = syscalls() - c0 - 1;
+  printf("%s\t%d bytes\t%d syscalls\t%d bytes/syscall\t%d ticks\n",
+         name, ROUNDS * FILESIZE, calls, ROUNDS * FILESIZE / calls,
+         uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, chunk;
+
+  chunk = argc > 1 ? atoi(argv[1]) : 64;
+  if(chunk <= 0 || chunk > FILESIZE){
+    fprintf(2, "usage: ringbench [chunk]\n");
+    exit(1);
+  }
+  if((r = ring_setup()) == (struct ring *)-1){
+    fprintf(2, "ringbench: ring_setup failed\n");
+    exit(1);
+  }
+  for(i = 0; i < FILESIZE; i++)
+    data[i] = i * 7;
+
+  run("write", 0, 1, chunk);
+  run("ringwrite", 1, 1, chunk);
+  run("read", 0, 0, chunk);
+  run("ringread", 1, 0, chunk);
+  unlink("ringbench.tmp");
+  exit(0);
+}
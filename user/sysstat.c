@@ -0,0 +1,79 @@
+// sysstat: run a command and summarize the system calls it made,
+// in the style of strace -c.
+//
+//   sysstat cmd [args...]   statistics for cmd and its children
+//   sysstat -a              statistics for every process since boot
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+struct sysstat st[NSYSCALL];
+
+void
+report(void)
+{
+  int i;
+  char *name;
+  uint64 calls, cycles;
+
+  calls = cycles = 0;
+  for(i = 0; i < NSYSCALL; i++){
+    calls += st[i].count;
+    cycles += st[i].cycles;
+  }
+
+  printf("%% time\tcalls\tcycles\tavg\tmax\tsyscall\n");
+  for(i = 0; i < NSYSCALL; i++){
+    if(st[i].count == 0)
+      continue;
+    if((name = syscallname(i)) == 0)
+      name = "?";
+    printf("%l\t%d\t%l\t%l\t%l\t%s\n",
+           cycles ? st[i].cycles * 100 / cycles : 0L,
+           st[i].count, st[i].cycles, st[i].cycles / st[i].count,
+           st[i].max, name);
+  }
+  printf("100\t%l\t%l\t\t\ttotal\n", calls, cycles);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(argc == 2 && strcmp(argv[1], "-a") == 0){
+    if(sysstat(SYSSTAT_ALL, st) < 0){
+      fprintf(2, "sysstat: sysstat failed\n");
+      exit(1);
+    }
+    report();
+    exit(0);
+  }
+  if(argc < 2){
+    fprintf(2, "usage: sysstat cmd [args...] | sysstat -a\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "sysstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+
+  // the child's statistics were folded into ours by wait().
+  if(sysstat(SYSSTAT_CHILDREN, st) < 0){
+    fprintf(2, "sysstat: sysstat failed\n");
+    exit(1);
+  }
+  report();
+  exit(0);
+}
@@ -0,0 +1,143 @@
+// tracestat: control the kernel trace device and summarize its records.
+//
+//   tracestat on       start recording
+//   tracestat off      stop recording
+//   tracestat          drain the trace and print latency histograms,
+//                      including how long processes waited to run
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define NSYS    64   // syscall numbers we keep statistics for
+#define NBUCKET 24   // log2 latency buckets, in mtime cycles
+
+struct stat1 {
+  uint64 count;
+  uint64 total;
+  uint64 max;
+  uint64 hist[NBUCKET];
+};
+
+struct stat1 sys[NSYS];
+struct stat1 disk;
+struct stat1 commit;
+struct stat1 schedwait;
+uint64 nfault, nswitch;
+
+struct tracerec buf[32];
+
+int
+bucket(uint64 cycles)
+{
+  int b;
+
+  for(b = 0; cycles > 1 && b < NBUCKET-1; b++)
+    cycles >>= 1;
+  return b;
+}
+
+void
+account(struct stat1 *s, uint64 cycles)
+{
+  s->count++;
+  s->total += cycles;
+  if(cycles > s->max)
+    s->max = cycles;
+  s->hist[bucket(cycles)]++;
+}
+
+void
+histogram(char *name, struct stat1 *s)
+{
+  int b, i, stars;
+
+  if(s->count == 0)
+    return;
+  printf("%s: %l calls, avg %l max %l cycles\n",
+         name, s->count, s->total / s->count, s->max);
+  for(b = 0; b < NBUCKET; b++){
+    if(s->hist[b] == 0)
+      continue;
+    printf("  %l-%l\t%l\t", b ? 1L << b : 0L, (1L << (b+1)) - 1, s->hist[b]);
+    stars = (s->hist[b] * 40) / s->count;
+    for(i = 0; i < stars || i == 0; i++)
+      printf("*");
+    printf("\n");
+  }
+}
+
+int
+control(char *arg)
+{
+  int fd;
+
+  if((fd = open("trace", O_WRONLY)) < 0){
+    fprintf(2, "tracestat: cannot open trace\n");
+    return -1;
+  }
+  if(write(fd, strcmp(arg, "on") == 0 ? "1" : "0", 1) != 1){
+    fprintf(2, "tracestat: write failed\n");
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n, num;
+  char *name;
+  struct tracerec *r;
+
+  if(argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0))
+    exit(control(argv[1]) < 0);
+  if(argc != 1){
+    fprintf(2, "usage: tracestat [on|off]\n");
+    exit(1);
+  }
+
+  if((fd = open("trace", O_RDONLY)) < 0){
+    fprintf(2, "tracestat: cannot open trace\n");
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(r = buf; r < buf + n / sizeof(buf[0]); r++){
+      switch(r->type){
+      case TR_SYSCALL_EXIT:
+        if(r->a0 < NSYS)
+          account(&sys[r->a0], r->a1);
+        break;
+      case TR_PAGEFAULT:
+        nfault++;
+        break;
+      case TR_SCHED_IN:
+        nswitch++;
+        account(&schedwait, r->a1);
+        break;
+      case TR_DISK_DONE:
+        account(&disk, r->a1);
+        break;
+      case TR_LOG_COMMIT:
+        account(&commit, r->a1);
+        break;
+      }
+    }
+  }
+  close(fd);
+
+  for(num = 0; num < NSYS; num++){
+    if((name = syscallname(num)) != 0)
+      histogram(name, &sys[num]);
+  }
+  histogram("disk", &disk);
+  histogram("commit", &commit);
+  histogram("sched wait", &schedwait);
+  printf("page faults: %l\n", nfault);
+  printf("context switches: %l\n", nswitch);
+  exit(0);
+}
@@ -1,8 +1,15 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/syscall.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/vdso.h"
 #include "user/user.h"
 
+// the kernel's read-only data page; see kernel/vdso.h.
+#define vdso ((struct vdso*)VDSO)
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -55,19 +62,52 @@ strchr(const char *s, char c)
 char*
 gets(char *buf, int max)
 {
-  int i, cc;
-  char c;
+  return fgets(0, buf, max);
+}
 
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return buf;
+// The buffered I/O in printf.c sets stdiosync once it holds
+// buffers.  stdiosync(fd, closing) writes fd's buffered output,
+// or every fd's if fd < 0, and forgets fd's buffers if closing.
+// These wrappers around the system calls of the same names, which
+// usys.S provides as _exit etc., call it before output could be
+// lost or duplicated.
+void (*stdiosync)(int, int);
+
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
+int _close(int);
+int _exec(char*, char**);
+
+int
+fork(void)
+{
+  if(stdiosync)
+    stdiosync(-1, 0);
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  if(stdiosync)
+    stdiosync(-1, 0);
+  _exit(status);
+}
+
+int
+close(int fd)
+{
+  if(stdiosync)
+    stdiosync(fd, 1);
+  return _close(fd);
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(stdiosync)
+    stdiosync(-1, 0);
+  return _exec(path, argv);
 }
 
 int
@@ -134,3 +174,83 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+static char *syscallnames[] = {
+[SYS_fork]        "fork",
+[SYS_exit]        "exit",
+[SYS_wait]        "wait",
+[SYS_pipe]        "pipe",
+[SYS_read]        "read",
+[SYS_kill]        "kill",
+[SYS_exec]        "exec",
+[SYS_fstat]       "fstat",
+[SYS_chdir]       "chdir",
+[SYS_dup]         "dup",
+[SYS_getpid]      "getpid",
+[SYS_sbrk]        "sbrk",
+[SYS_sleep]       "sleep",
+[SYS_uptime]      "uptime",
+[SYS_open]        "open",
+[SYS_write]       "write",
+[SYS_mknod]       "mknod",
+[SYS_unlink]      "unlink",
+[SYS_link]        "link",
+[SYS_mkdir]       "mkdir",
+[SYS_close]       "close",
+[SYS_freepmem]    "freepmem",
+[SYS_mmap]        "mmap",
+[SYS_munmap]      "munmap",
+[SYS_sem_init]    "sem_init",
+[SYS_sem_destroy] "sem_destroy",
+[SYS_sem_wait]    "sem_wait",
+[SYS_sem_post]    "sem_post",
+[SYS_sysstat]     "sysstat",
+[SYS_ring_setup]  "ring_setup",
+[SYS_ring_enter]  "ring_enter",
+[SYS_pread]       "pread",
+[SYS_pwrite]      "pwrite",
+[SYS_readv]       "readv",
+[SYS_writev]      "writev",
+[SYS_nanosleep]   "nanosleep",
+[SYS_setpriority] "setpriority",
+[SYS_schedstat]   "schedstat",
+[SYS_sched_setaffinity] "sched_setaffinity",
+[SYS_sched_getaffinity] "sched_getaffinity",
+[SYS_klogread]    "klogread",
+};
+
+// Name of system call number num, or 0 if there is none.
+char*
+syscallname(int num)
+{
+  if(num <= 0 || num >= sizeof(syscallnames)/sizeof(syscallnames[0]))
+    return 0;
+  return syscallnames[num];
+}
+
+// Like uptime() and getpid(), but read from the vdso page
+// instead of entering the kernel.
+int
+vdso_uptime(void)
+{
+  return vdso->ticks;
+}
+
+int
+vdso_getpid(void)
+{
+  return vdso->pid;
+}
+
+// CPU this process is running on, as of the last tick.
+int
+vdso_cpuid(void)
+{
+  return vdso->cpu;
+}
+
+uint64
+vdso_freepages(void)
+{
+  return vdso->freepages;
+}
@@ -1,5 +1,10 @@
 struct stat;
 struct rtcdate;
+struct sysstat;
+struct ring;
+struct iovec;
+struct schedstat;
+struct klogrec;
 
 // system calls
 int fork(void);
@@ -28,6 +33,19 @@ int sem_init(sem_t *sem, int pshared, unsigned int value);
 int sem_destroy(sem_t *sem);
 int sem_wait(sem_t *sem);
 int sem_post(sem_t *sem);
+int sysstat(int, struct sysstat*);
+struct ring* ring_setup(void);
+int ring_enter(int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int nanosleep(uint64);
+int setpriority(int, int);
+int schedstat(int, struct schedstat*);
+int sched_setaffinity(int, uint);
+int sched_getaffinity(int);
+int klogread(uint, struct klogrec*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -38,6 +56,10 @@ int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
 char* gets(char*, int max);
+char* fgets(int, char*, int max);
+int fwrite(int, const void*, int);
+void fflush(int);
+extern void (*stdiosync)(int, int);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
@@ -45,5 +67,10 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+char* syscallname(int);
+int vdso_uptime(void);
+int vdso_getpid(void);
+int vdso_cpuid(void);
+uint64 vdso_freepages(void);
 void *mmap(void *addr, uint length, int prot, int flags, int fd, int offset); // HOMEWORK 5, mmap and munmap
 int   munmap(void *addr, uint length);  // HOMEWORK 5, mmap and munmap
@@ -7,6 +7,9 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/ring.h"
+#include "kernel/schedstat.h"
+#include "kernel/klog.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -569,6 +572,11 @@ writetest(char *s)
   }
 }
 
+// a file reaching into the doubly-indirect blocks, across
+// two of their indirect blocks.  MAXFILE itself is too big to
+// write in reasonable time.
+#define NBIG (NDIRECT + NINDIRECT + 2*NINDIRECT + 1)
+
 void
 writebig(char *s)
 {
@@ -580,7 +588,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < NBIG; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -600,7 +608,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != NBIG){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -2706,6 +2714,702 @@ execout(char *s)
   exit(0);
 }
 
+// queue one operation on a submission ring, run it, and
+// return its result.
+static int
+ringdo(struct ring *r, int op, int fd, void *addr, int n)
+{
+  struct ring_sqe *e = &r->sq[r->sq_tail % RING_ENTRIES];
+  int res;
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->n = n;
+  e->data = r->sq_tail;
+  r->sq_tail++;
+  if(ring_enter(1) != 1 || r->cq_tail != r->cq_head + 1 ||
+     r->cq[r->cq_head % RING_ENTRIES].data != e->data)
+    return -2;
+  res = r->cq[r->cq_head % RING_ENTRIES].res;
+  r->cq_head++;
+  return res;
+}
+
+// operations submitted through the ring behave like the
+// system calls they stand for, in a forked child as well.
+void
+ringtest(char *s)
+{
+  struct ring *r;
+  char buf[8];
+  sem_t sem;
+  int fd, pid, xstatus;
+
+  r = ring_setup();
+  if(r == (struct ring *)-1){
+    printf("%s: ring_setup failed\n", s);
+    exit(1);
+  }
+  if(ring_setup() != (struct ring *)-1){
+    printf("%s: second ring_setup succeeded\n", s);
+    exit(1);
+  }
+  if(ring_enter(1) != 0){
+    printf("%s: ring_enter of empty ring\n", s);
+    exit(1);
+  }
+  if((fd = ringdo(r, RING_OPEN, 0, "ringtest", O_CREATE|O_RDWR)) < 0){
+    printf("%s: ring open failed\n", s);
+    exit(1);
+  }
+  if(ringdo(r, RING_WRITE, fd, "ringdata", 8) != 8 ||
+     ringdo(r, RING_CLOSE, fd, 0, 0) != 0 ||
+     ringdo(r, RING_CLOSE, fd, 0, 0) != -1){
+    printf("%s: ring write/close failed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // the child has its own copy of the ring.
+    if((fd = ringdo(r, RING_OPEN, 0, "ringtest", O_RDONLY)) < 0 ||
+       ringdo(r, RING_READ, fd, buf, 8) != 8 ||
+       memcmp(buf, "ringdata", 8) != 0){
+      printf("%s: ring read in child failed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  sem_init(&sem, 0, 0);
+  if(ringdo(r, RING_SEM_POST, 0, &sem, 0) != 0 ||
+     ringdo(r, RING_SEM_WAIT, 0, &sem, 0) != 0){
+    printf("%s: ring semaphore ops failed\n", s);
+    exit(1);
+  }
+  sem_destroy(&sem);
+  if(ringdo(r, 99, 0, 0, 0) != -1){
+    printf("%s: bad ring op succeeded\n", s);
+    exit(1);
+  }
+  unlink("ringtest");
+  exit(0);
+}
+
+// exec() must take down the old image's ring and mmap()'d
+// regions along with the rest of it.
+void
+ringexec(char *s)
+{
+  char *args[] = { "echo", "x", 0 };
+  char *priv, *shared;
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    priv = mmap(0, 4096, PROT_READ | PROT_WRITE,
+                MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    shared = mmap(0, 4096, PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+    if(ring_setup() == (struct ring *)-1 ||
+       priv == (char *)-1 || shared == (char *)-1){
+      printf("%s: ring_setup or mmap failed\n", s);
+      exit(1);
+    }
+    priv[0] = 1;
+    shared[0] = 1;
+    close(1);
+    exec("echo", args);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: exec after ring_setup failed\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// the vdso page agrees with the system calls it stands in for,
+// is per-process, and cannot be written.
+void
+vdsotest(char *s)
+{
+  int pid, xstatus, t;
+
+  if(vdso_getpid() != getpid()){
+    printf("%s: vdso pid %d, getpid %d\n", s, vdso_getpid(), getpid());
+    exit(1);
+  }
+  t = uptime();
+  if(vdso_uptime() < t - 1 || vdso_uptime() > t + 1){
+    printf("%s: vdso ticks %d, uptime %d\n", s, vdso_uptime(), t);
+    exit(1);
+  }
+  sleep(2);
+  if(vdso_uptime() < t + 2){
+    printf("%s: vdso ticks did not advance\n", s);
+    exit(1);
+  }
+  if(vdso_freepages() == 0 || vdso_cpuid() < 0 || vdso_cpuid() >= NCPU){
+    printf("%s: bad vdso freepages or cpu\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(vdso_getpid() != getpid())
+      exit(1);
+    *(volatile int *)VDSO = 0;
+    exit(2);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child could write the vdso page\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// exec leaves text, data and bss to be faulted in: system calls
+// must be able to fill pages nobody has touched yet, and fork
+// must copy a partly-present image.
+static char untouched[16*4096];
+
+void
+demandpage(char *s)
+{
+  int fd, pid, xstatus;
+
+  fd = open("echo", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open echo failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(read(fd, untouched + 9*4096 + 100, 2*4096) != 2*4096 ||
+       untouched[9*4096 + 101] != 'E'){
+      printf("%s: read into untouched bss failed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  close(fd);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(untouched[9*4096 + 101] != 0){
+    printf("%s: child's bss write reached the parent\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// pages of the executable are shared with the text cache and
+// other processes until written: neither a store nor a read()
+// into one may be seen by another process.
+static char initialized[3*4096] = { [4096] = 'x', [2*4096] = 'y' };
+
+void
+sharedtext(char *s)
+{
+  int fd, pid, xstatus;
+
+  if(initialized[4096] != 'x' || initialized[2*4096] != 'y'){
+    printf("%s: initialized data wrong\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    initialized[4096] = 'c';
+    fd = open("echo", O_RDONLY);
+    if(fd < 0 || read(fd, initialized + 2*4096, 4) != 4){
+      printf("%s: read into data failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(initialized[4096] != 'c' || initialized[2*4096+1] != 'E')
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(initialized[4096] != 'x' || initialized[2*4096] != 'y'){
+    printf("%s: child's write reached the parent\n", s);
+    exit(1);
+  }
+  initialized[4096] = 'p';
+  if(initialized[4096] != 'p')
+    exit(1);
+  exit(0);
+}
+
+// wait() and pipe reads copy out with spinlocks held, so they
+// cannot read a page of the executable in then: the kernel must
+// bring the page in before it takes the locks.
+static int lockeddata[3*1024] = { [1024] = 7, [2*1024] = 7 };
+
+void
+lockedcopy(char *s)
+{
+  int fds[2], pid;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(3);
+  if(wait(&lockeddata[1024]) != pid || lockeddata[1024] != 3){
+    printf("%s: wait into untouched data failed\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], "abcd", 4) != 4 ||
+     read(fds[0], &lockeddata[2*1024], 4) != 4 ||
+     memcmp(&lockeddata[2*1024], "abcd", 4) != 0){
+    printf("%s: pipe read into untouched data failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  exit(0);
+}
+
+// sleepers with different deadlines wake in deadline order,
+// and nanosleep() sleeps at least as long as asked.
+void
+sleeptimers(char *s)
+{
+  int fds[2], i, pid, t0;
+  char c, order[4];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      sleep(2 + 3 * (3 - i));
+      c = '0' + i;
+      write(fds[1], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < 4; i++){
+    if(read(fds[0], &order[i], 1) != 1){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  for(i = 0; i < 4; i++)
+    wait(0);
+  if(order[0] != '3' || order[1] != '2' || order[2] != '1' || order[3] != '0'){
+    printf("%s: sleepers woke out of order\n", s);
+    exit(1);
+  }
+
+  t0 = uptime();
+  if(nanosleep(250000000) < 0){
+    printf("%s: nanosleep failed\n", s);
+    exit(1);
+  }
+  if(uptime() - t0 < 2){
+    printf("%s: nanosleep returned early\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// setpriority() checks its range, nice values are inherited,
+// and schedstat() accounts for CPU time.
+void
+nicetest(char *s)
+{
+  struct schedstat st;
+  int pid, xstatus;
+  volatile int i;
+
+  if(setpriority(0, NICE_MAX + 1) != -1 || setpriority(0, NICE_MIN - 1) != -1){
+    printf("%s: setpriority accepted a bad nice value\n", s);
+    exit(1);
+  }
+  if(setpriority(0, 5) < 0 || schedstat(0, &st) < 0 || st.nice != 5){
+    printf("%s: setpriority(0, 5) did not take\n", s);
+    exit(1);
+  }
+  if(schedstat(-1, &st) != -1){
+    printf("%s: schedstat of no process succeeded\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < 10000000; i++)
+      ;
+    if(schedstat(0, &st) < 0 || st.nice != 5 || st.runtime == 0 || st.nrun == 0)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child's nice or accounting wrong\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// a process pinned to a CPU runs only there, and its children
+// inherit the pinning.
+void
+affinitytest(char *s)
+{
+  int i, pid, xstatus;
+
+  if(sched_getaffinity(0) <= 0){
+    printf("%s: sched_getaffinity failed\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 0) != -1){
+    printf("%s: sched_setaffinity accepted no CPUs\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 1) < 0 || sched_getaffinity(0) != 1){
+    printf("%s: cannot pin to CPU 0\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < 5; i++){
+      if(vdso_cpuid() != 0)
+        exit(1);
+      sleep(1);
+    }
+    exit(sched_getaffinity(0) != 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: pinned child ran elsewhere\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// each sem_post() wakes one of several waiters, and none is lost
+// when posts arrive faster than the waiters run.
+void
+semwakeone(char *s)
+{
+  sem_t *sem;
+  int i, pid, xstatus;
+
+  sem = mmap(0, sizeof(*sem), PROT_READ | PROT_WRITE,
+             MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if(sem == (sem_t*)-1 || sem_init(sem, 1, 0) < 0){
+    printf("%s: semaphore setup failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 6; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      sem_wait(sem);
+      exit(0);
+    }
+  }
+  sleep(2);
+  for(i = 0; i < 6; i++)
+    sem_post(sem);
+  for(i = 0; i < 6; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: waiter failed\n", s);
+      exit(1);
+    }
+  }
+  sem_destroy(sem);
+  munmap(sem, sizeof(*sem));
+  exit(0);
+}
+
+// faults are logged to the kernel log with consecutive sequence
+// numbers, and a process that faults over and over is rate limited.
+void
+klogtest(char *s)
+{
+  static struct klogrec rec[NKLOG];
+  enum { NFAULT = 3 * RATEBURST };
+  int i, n, pid, logged;
+  uint last;
+
+  // find the newest message, and start a fresh rate limit interval.
+  last = 0;
+  while((n = klogread(last + 1, rec, NKLOG)) > 0)
+    last = rec[n-1].seq;
+  if(n < 0){
+    printf("%s: klogread failed\n", s);
+    exit(1);
+  }
+  sleep(RATEINTERVAL);
+
+  for(i = 0; i < NFAULT; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      *(volatile char *)KERNBASE = 1;
+      exit(0);
+    }
+    wait(0);
+  }
+
+  n = klogread(last + 1, rec, NKLOG);
+  logged = 0;
+  for(i = 0; i < n; i++){
+    if(rec[i].seq != last + 1 + i){
+      printf("%s: message %d has sequence number %d\n", s, last + 1 + i, rec[i].seq);
+      exit(1);
+    }
+    if(rec[i].len >= 19 && memcmp(rec[i].text, "usertrap(): invalid", 19) == 0)
+      logged++;
+  }
+  if(logged == 0 || logged > RATEBURST){
+    printf("%s: %d of %d faults logged\n", s, logged, NFAULT);
+    exit(1);
+  }
+  exit(0);
+}
+
+// more processes than the static process table holds can run at
+// once, and a process can hold more than the old 16 descriptors.
+void
+bigtables(char *s)
+{
+  enum { NCHILD = 100, NFD = 60 };
+  int fds[2], fd[NFD], i, n, pid, xstatus;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(n = 0; n < NCHILD; n++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork %d failed\n", s, n);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[1]);
+      if(read(fds[0], &c, 1) != 0)
+        exit(1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < NCHILD; i++){
+    if(wait(&xstatus) < 0 || xstatus != 0){
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+  }
+
+  for(i = 0; i < NFD; i++){
+    if((fd[i] = open("README", O_RDONLY)) < 0){
+      printf("%s: open %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NFD; i++)
+    close(fd[i]);
+  exit(0);
+}
+
+// buffered printf output reaches the file by close and exit,
+// is not duplicated by fork, and fgets reads it back by lines.
+void
+stdiotest(char *s)
+{
+  char line[32];
+  int fd, pid, xstatus, i;
+
+  fd = open("stdiotest", O_CREATE|O_WRONLY|O_TRUNC);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++)
+    fprintf(fd, "%d\n", i);
+  fprintf(fd, "parent ");
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    fprintf(fd, "child\n");
+    exit(0);  // not close: exit must flush
+  }
+  wait(&xstatus);
+  close(fd);
+
+  fd = open("stdiotest", O_RDONLY);
+  for(i = 0; i < 100; i++){
+    fgets(fd, line, sizeof(line));
+    if(atoi(line) != i || line[strlen(line)-1] != '\n'){
+      printf("%s: line %d reads back as %s\n", s, i, line);
+      exit(1);
+    }
+  }
+  fgets(fd, line, sizeof(line));
+  if(strcmp(line, "parent child\n") != 0){
+    printf("%s: last line reads back as %s\n", s, line);
+    exit(1);
+  }
+  if(fgets(fd, line, sizeof(line))[0] != 0){
+    printf("%s: output duplicated\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("stdiotest");
+  exit(0);
+}
+
+// pread/pwrite use their own offset; readv/writev gather and
+// scatter several buffers, including across block boundaries.
+void
+vectorio(char *s)
+{
+  static char big[3*BSIZE], back[3*BSIZE];
+  struct iovec iov[3];
+  char buf[8];
+  int fd, fds[2], i;
+
+  for(i = 0; i < sizeof(big); i++)
+    big[i] = i % 251;
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = big;
+  iov[1].iov_len = sizeof(big);
+  iov[2].iov_base = "xyz";
+  iov[2].iov_len = 3;
+
+  fd = open("vectorio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  if(writev(fd, iov, 3) != sizeof(big) + 6){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "ABC", 3, 0) != 3 || pread(fd, buf, 3, 0) != 3 ||
+     memcmp(buf, "ABC", 3) != 0){
+    printf("%s: pwrite/pread failed\n", s);
+    exit(1);
+  }
+  // neither moved the file offset.
+  if(write(fd, "!", 1) != 1 || pread(fd, buf, 4, sizeof(big) + 3) != 4 ||
+     memcmp(buf, "xyz!", 4) != 0){
+    printf("%s: pread/pwrite moved the offset\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf, 8, sizeof(big) + 7) != 0){
+    printf("%s: pread past end of file\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("vectorio", O_RDONLY);
+  iov[0].iov_base = buf;
+  iov[1].iov_base = back;
+  iov[2].iov_base = buf + 3;
+  iov[2].iov_len = 8;
+  if(readv(fd, iov, 3) != sizeof(big) + 7 || memcmp(buf, "ABCxyz!", 7) != 0 ||
+     memcmp(back, big, sizeof(big)) != 0){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  if(readv(fd, iov, MAXIOV + 1) != -1){
+    printf("%s: readv with too many buffers succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("vectorio");
+
+  // pipes have no offset to read at.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(pread(fds[0], buf, 1, 0) != -1 || pwrite(fds[1], "a", 1, 0) != -1){
+    printf("%s: pread/pwrite on a pipe succeeded\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "ab";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = "cd";
+  iov[1].iov_len = 2;
+  if(writev(fds[1], iov, 2) != 4 || read(fds[0], buf, 4) != 4 ||
+     memcmp(buf, "abcd", 4) != 0){
+    printf("%s: writev to a pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  exit(0);
+}
+
 //
 // use sbrk() to count how many free physical memory pages there are.
 // touches the pages to force allocation.
@@ -2821,6 +3525,20 @@ main(int argc, char *argv[])
     {MAXVAplus, "MAXVAplus"},
     {manywrites, "manywrites"},
     {execout, "execout"},
+    {ringtest, "ringtest"},
+    {ringexec, "ringexec"},
+    {vdsotest, "vdsotest"},
+    {vectorio, "vectorio"},
+    {stdiotest, "stdiotest"},
+    {demandpage, "demandpage"},
+    {sharedtext, "sharedtext"},
+    {lockedcopy, "lockedcopy"},
+    {sleeptimers, "sleeptimers"},
+    {nicetest, "nicetest"},
+    {affinitytest, "affinitytest"},
+    {semwakeone, "semwakeone"},
+    {bigtables, "bigtables"},
+    {klogtest, "klogtest"},
     {copyin, "copyin"},
     {copyout, "copyout"},
     {copyinstr1, "copyinstr1"},
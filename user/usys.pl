@@ -6,24 +6,27 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry(name, symbol): symbol defaults to name.  ulib.c wraps
+# some system calls, so their stubs go under other names.
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $sym = shift || $name;
+    print ".global $sym\n";
+    print "${sym}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+entry("fork", "_fork");
+entry("exit", "_exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
-entry("close");
+entry("close", "_close");
 entry("kill");
-entry("exec");
+entry("exec", "_exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -43,3 +46,16 @@ entry("sem_init");
 entry("sem_destroy");
 entry("sem_wait");
 entry("sem_post");
+entry("sysstat");
+entry("ring_setup");
+entry("ring_enter");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("nanosleep");
+entry("setpriority");
+entry("schedstat");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("klogread");